@@ -7,6 +7,7 @@
 #define N1_CSV_PARSER_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define N1_CSV_STATIC_API static
 
@@ -34,24 +35,234 @@ typedef struct n1_CSV_Parser   n1_CSV_Parser;
 typedef struct n1_CSV_Cell     n1_CSV_Cell;
 typedef struct n1_CSV_CellPage n1_CSV_CellPage;
 typedef struct n1_CSV_String   n1_CSV_String;
+typedef struct n1_CSV_ThreadPool n1_CSV_ThreadPool;
+typedef struct n1_CSV_Arena    n1_CSV_Arena;
+typedef struct n1_CSV_ColumnSchema n1_CSV_ColumnSchema;
+typedef struct n1_CSV_Schema   n1_CSV_Schema;
+typedef struct n1_CSV_CellRef  n1_CSV_CellRef;
 
 /* API struct definitions */
 
+typedef enum N1_CSV_CELL_LAYOUT{
+  //start and end of each cell in row order
+  N1_CSV_CELL_LAYOUT_ROWS = 0,
+  //one array of cell starts per column, see n1_csv_get_column
+  N1_CSV_CELL_LAYOUT_COLUMNS,
+  //only row starts, rows are split again when their cells are read. See n1_csv_set_row_sampling
+  N1_CSV_CELL_LAYOUT_SPARSE,
+} N1_CSV_CELL_LAYOUT;
+
+//How parsers that read the file page by page read it, see n1_csv_set_io
+typedef enum N1_CSV_IO{
+  //blocking pread of one block at a time
+  N1_CSV_IO_PREAD = 0,
+  //several reads in flight on io_uring, pread when the kernel doesn't support it
+  N1_CSV_IO_URING,
+} N1_CSV_IO;
+
+//Value types for n1_csv_convert_column
+typedef enum N1_CSV_TYPE{
+  //int64_t
+  N1_CSV_TYPE_INT64 = 0,
+  //double
+  N1_CSV_TYPE_DOUBLE,
+  //uint8_t, 0 or 1. Accepts true/false, yes/no, t/f, y/n and 1/0 in any case
+  N1_CSV_TYPE_BOOL,
+  //int64_t, microseconds since 1970-01-01 UTC. Accepts YYYY-MM-DD with an optional time
+  //HH:MM[:SS[.ffffff]] after a 'T' or a space, and an optional trailing 'Z'
+  N1_CSV_TYPE_TIMESTAMP,
+  //anything else, not converted
+  N1_CSV_TYPE_STRING,
+} N1_CSV_TYPE;
+
+typedef struct n1_CSV_ColumnSchema{
+  N1_CSV_TYPE type;
+  
+  //an empty cell was sampled
+  int8_t      nullable;
+  
+  //longest sampled cell in bytes, without quotes
+  uint32_t    max_width;
+  
+} n1_CSV_ColumnSchema;
+
+//Column types found by n1_csv_infer_schema
+typedef struct n1_CSV_Schema{
+  uint32_t             column_count;
+  uint32_t             sampled_rows;
+  char                 quote_token;
+  n1_CSV_ColumnSchema* columns;
+  
+} n1_CSV_Schema;
+
 typedef struct n1_CSV_String{
   char*    data;
   uint32_t length;
 } n1_CSV_String;
 
+//cell fetched by n1_csv_get_cells
+typedef struct n1_CSV_CellRef{
+  uint32_t row;
+  uint32_t column;
+} n1_CSV_CellRef;
+
+//Called by n1_csv_parse_stream for each row. Cells point into a window of the file and are
+//only valid until the function returns. Return 0 to stop parsing.
+typedef int (*n1_CSV_RowProc)(void* user_data, uint64_t row, n1_CSV_String* cells, uint32_t cell_count);
+
 /* API function declaration */
 
 N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser(const char* filename);
 
+//Maps the whole file into memory. Tokenizers and n1_csv_get_cell_transient work
+//directly on the mapped bytes. Falls back to paged reads if the file can't be mapped.
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_mapped(const char* filename);
+
+//Parses size bytes of data in place. Cells point straight into data, which has to stay valid
+//until the parser is destroyed. data doesn't need to be null terminated.
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_from_buffer(const char* data, size_t size);
+
+//Regular files are mapped from the start. Pipes and sockets are read to the end into memory.
+//fd stays owned by the caller and can be closed after this returns.
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_from_fd(int fd);
+
 N1_CSV_STATIC_API void n1_destroy_csv_parser( n1_CSV_Parser* parser);
 
+//Worker threads that stay parked between parses. Token and cell buffers are kept
+//and reused by the next parse. thread_count of 0 uses one thread per processor.
+//A pool runs one parse at a time.
+N1_CSV_STATIC_API n1_CSV_ThreadPool* n1_create_csv_thread_pool(uint32_t thread_count);
+
+N1_CSV_STATIC_API void n1_destroy_csv_thread_pool(n1_CSV_ThreadPool* pool);
+
+//threaded parse functions run on pool instead of starting their own threads. NULL to stop using a pool.
+N1_CSV_STATIC_API void n1_csv_set_thread_pool(n1_CSV_Parser* parser, n1_CSV_ThreadPool* pool);
+
+//Cell, row and token buffers that parsers free go back to an arena, and later parses take them again
+//instead of allocating new ones. Parsers sharing an arena can parse at the same time.
+//Destroy an arena after the parsers using it.
+N1_CSV_STATIC_API n1_CSV_Arena* n1_create_csv_arena();
+
+N1_CSV_STATIC_API void n1_destroy_csv_arena(n1_CSV_Arena* arena);
+
+//parser takes and gives back its buffers through arena. NULL to allocate them again.
+N1_CSV_STATIC_API void n1_csv_set_arena(n1_CSV_Parser* parser, n1_CSV_Arena* arena);
+
 N1_CSV_STATIC_API n1_CSV_String n1_csv_get_cell_transient(n1_CSV_Parser* parser,
                                                           uint32_t column,
                                                           uint32_t row);
 
+//Converts cells of column on rows first_row .. first_row + row_count - 1 into values, an array of row_count
+//values of type. Surrounding quote_tokens and a trailing '\r' are ignored. Empty cells and cells that don't
+//convert are 0 in values and their bit is set in null_bitmap, which holds (row_count + 63) / 64 words and
+//can be NULL. Returns the number of cells converted.
+N1_CSV_STATIC_API uint64_t n1_csv_convert_column(n1_CSV_Parser* parser,
+                                                 uint32_t column,
+                                                 uint32_t first_row,
+                                                 uint32_t row_count,
+                                                 char quote_token,
+                                                 N1_CSV_TYPE type,
+                                                 void* values,
+                                                 uint64_t* null_bitmap);
+
+//Size of one value of type in n1_csv_convert_column, 0 for N1_CSV_TYPE_STRING
+N1_CSV_STATIC_API uint32_t n1_csv_get_type_size(N1_CSV_TYPE type);
+
+//Guesses the type of every column from sample_rows rows spread evenly over rows first_row .. row_count - 1.
+//A column is the first of int64, bool, double and timestamp that all its sampled non-empty cells convert to,
+//or a string. Columns of only 0 and 1 are int64.
+N1_CSV_STATIC_API n1_CSV_Schema* n1_csv_infer_schema(n1_CSV_Parser* parser,
+                                                     uint32_t first_row,
+                                                     uint32_t sample_rows,
+                                                     char quote_token);
+
+N1_CSV_STATIC_API void n1_destroy_csv_schema(n1_CSV_Schema* schema);
+
+//Converts rows first_row .. first_row + row_count - 1 of every column with a type in schema, see n1_csv_convert_column.
+//values[i] holds row_count values of n1_csv_get_type_size(schema->columns[i].type) bytes, string columns and
+//columns with a NULL array are skipped. null_bitmaps can be NULL. Returns the number of cells converted.
+N1_CSV_STATIC_API uint64_t n1_csv_convert_columns(n1_CSV_Parser* parser,
+                                                  n1_CSV_Schema* schema,
+                                                  uint32_t first_row,
+                                                  uint32_t row_count,
+                                                  void** values,
+                                                  uint64_t** null_bitmaps);
+
+//Only the selected columns are stored by the following parses, in the order they are in the file. Cells of other
+//columns are skipped while rows are built, and columns passed to other functions count selected columns only.
+//column_count of 0 selects every column again.
+N1_CSV_STATIC_API void n1_csv_select_columns(n1_CSV_Parser* parser, const uint32_t* columns, uint32_t column_count);
+
+//Same as n1_csv_select_columns, with names matched to the cells of the first row when each parse starts.
+//Names that aren't in the first row select nothing.
+N1_CSV_STATIC_API void n1_csv_select_columns_by_name(n1_CSV_Parser* parser, const char** names, uint32_t name_count);
+
+//Row filters for the following parses. Rows are kept if they pass every filter, others are dropped while
+//rows are built. column counts every column of the file, including columns that aren't selected. Cells are
+//compared without surrounding quotes and a trailing '\r', with doubled quotes read as one, so values are
+//given unescaped. The first row is checked like any other. Parsers that read the file page by page still
+//tokenize it page by page, the filters read the cells through a mapping that is only kept for the parse.
+//Parses with filters leave the parser empty when the file can't be mapped.
+
+//keeps rows where column is value
+N1_CSV_STATIC_API void n1_csv_add_filter_equal(n1_CSV_Parser* parser, uint32_t column, const char* value);
+
+//keeps rows where column starts with prefix
+N1_CSV_STATIC_API void n1_csv_add_filter_prefix(n1_CSV_Parser* parser, uint32_t column, const char* prefix);
+
+//keeps rows where column is a number from min to max
+N1_CSV_STATIC_API void n1_csv_add_filter_range(n1_CSV_Parser* parser, uint32_t column, double min, double max);
+
+//keeps rows where column is one of value_count values
+N1_CSV_STATIC_API void n1_csv_add_filter_in(n1_CSV_Parser* parser, uint32_t column, const char** values, uint32_t value_count);
+
+N1_CSV_STATIC_API void n1_csv_clear_filters(n1_CSV_Parser* parser);
+
+//Layout cells are stored in by the following parses. N1_CSV_CELL_LAYOUT_ROWS by default.
+N1_CSV_STATIC_API void n1_csv_set_cell_layout(n1_CSV_Parser* parser, N1_CSV_CELL_LAYOUT layout);
+
+//N1_CSV_CELL_LAYOUT_SPARSE keeps the start of every interval-th row, and rows in between are found by
+//tokenizing forward from the row before them. 1 by default. Rows are all kept when there are filters.
+N1_CSV_STATIC_API void n1_csv_set_row_sampling(n1_CSV_Parser* parser, uint32_t interval);
+
+//Start of the cell in column on every row, relative to n1_CSV_Parser::row_offsets. A cell ends one byte
+//before the cell in the next column starts, and column == column_count gives the ends of the last column
+//the same way. NULL unless the last parse used N1_CSV_CELL_LAYOUT_COLUMNS.
+N1_CSV_STATIC_API const uint32_t* n1_csv_get_column(n1_CSV_Parser* parser, uint32_t column);
+
+//Cells read from a file that isn't in memory go through a cache of cache_size bytes, in blocks of
+//N1_CSV_PAGE_CACHE_BLOCK_SIZE evicted with the CLOCK algorithm. A miss on the block after the previous miss
+//reads read_ahead more blocks with it. cache_size smaller than a block reads the page of each cell on its own.
+//Defaults are N1_CSV_PAGE_CACHE_SIZE and N1_CSV_PAGE_READ_AHEAD.
+N1_CSV_STATIC_API void n1_csv_set_page_cache(n1_CSV_Parser* parser, size_t cache_size, uint32_t read_ahead);
+
+//cells n1_csv_get_cell_transient found in memory and cells it had to read from the file
+N1_CSV_STATIC_API void n1_csv_get_page_cache_stats(n1_CSV_Parser* parser, uint64_t* hits, uint64_t* misses);
+
+//Workers tokenizing a file that isn't in memory read it in blocks of n1_csv_set_read_block_size with io, keeping
+//queue_depth reads in flight so a block is tokenized while the next ones are read. direct opens the file with
+//O_DIRECT, which skips the OS page cache for files read once, and is ignored where the file system doesn't allow it.
+//Files smaller than N1_CSV_URING_MIN_FILE_SIZE are read with pread. io_uring and O_DIRECT are Linux only, and
+//direct is off on architectures other than x86 unless fcntl.h declares O_DIRECT.
+//Defaults are N1_CSV_IO_URING with N1_CSV_READ_QUEUE_DEPTH reads in flight.
+N1_CSV_STATIC_API void n1_csv_set_io(n1_CSV_Parser* parser, N1_CSV_IO io, uint32_t queue_depth, int8_t direct);
+
+//Bytes read and tokenized at a time by workers of a file that isn't in memory, rounded up to a page.
+//With pread the next block is prefetched into the OS page cache while one is tokenized. N1_CSV_READ_BLOCK_SIZE
+//by default. Blocks don't go past the section of a worker, so sizes above N1_CSV_MAX_MORSEL_SIZE only matter
+//for n1_csv_parse_slow.
+N1_CSV_STATIC_API void n1_csv_set_read_block_size(n1_CSV_Parser* parser, size_t block_size);
+
+//Fetches the cells at refs into cells, in the order of refs. Cells are looked up in file order, and a file
+//that isn't in memory is read once per range of nearby cells, bypassing the page cache. Unlike
+//n1_csv_get_cell_transient, cells stay valid until the next batch fetch, parse, refresh or destroy.
+//Cells that don't exist are empty with NULL data. Returns the number of cells found.
+N1_CSV_STATIC_API uint64_t n1_csv_get_cells(n1_CSV_Parser* parser, const n1_CSV_CellRef* refs, uint64_t ref_count, n1_CSV_String* cells);
+
+//Same as n1_csv_get_cells for every column of rows first_row .. first_row + row_count - 1, row by row.
+//cells holds row_count * column_count strings.
+N1_CSV_STATIC_API uint64_t n1_csv_get_rows(n1_CSV_Parser* parser, uint32_t first_row, uint32_t row_count, n1_CSV_String* cells);
+
 //API for single-threaded parsing
 N1_CSV_STATIC_API void n1_csv_parse_slow(n1_CSV_Parser* parser,
                                          char delim_token,
@@ -74,6 +285,62 @@ N1_CSV_STATIC_API void n1_csv_parse_threaded_avx256(n1_CSV_Parser* parser,
                                                     char quote_token,
                                                     char row_token);
 
+//needs avx512bw
+N1_CSV_STATIC_API void n1_csv_parse_threaded_avx512(n1_CSV_Parser* parser,
+                                                    char delim_token,
+                                                    char quote_token,
+                                                    char row_token);
+
+//multi-threaded parse with the fastest tokenizer the cpu supports, checked once with cpuid
+N1_CSV_STATIC_API void n1_csv_parse_auto(n1_CSV_Parser* parser,
+                                         char delim_token,
+                                         char quote_token,
+                                         char row_token);
+
+//Parses bytes appended to the file since the last parse and extends cell_data in place.
+//The last row is parsed again, since it may continue in the new bytes. Does nothing for
+//parsers created from a buffer or an fd. Bytes before the last row are assumed unchanged,
+//and a file truncated before the last row is parsed again from the start.
+N1_CSV_STATIC_API void n1_csv_refresh(n1_CSV_Parser* parser,
+                                      char delim_token,
+                                      char quote_token,
+                                      char row_token);
+
+//Writes the cells of the last parse to index_filename, so a later n1_csv_load_index can map them instead
+//of parsing again. The index is keyed by the size and modification time of the file, a hash of blocks sampled
+//over it, the tokens, the cell layout, selected columns and filters. NULL writes next to the file, with
+//".n1idx" appended to its name. Returns 0 if the index couldn't be written or the parser has no file name.
+N1_CSV_STATIC_API int n1_csv_save_index(n1_CSV_Parser* parser,
+                                        const char* index_filename,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token);
+
+//Maps an index written by n1_csv_save_index if it matches the file and the parser settings.
+//Returns 0 if there is no matching index and the file has to be parsed. Cells stay mapped until
+//the next parse or refresh, which copies them out first.
+N1_CSV_STATIC_API int n1_csv_load_index(n1_CSV_Parser* parser,
+                                        const char* index_filename,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token);
+
+//Loads the index, or parses with n1_csv_parse_auto and saves it
+N1_CSV_STATIC_API void n1_csv_parse_cached(n1_CSV_Parser* parser,
+                                           const char* index_filename,
+                                           char delim_token,
+                                           char quote_token,
+                                           char row_token);
+
+//API for streaming. The file is tokenized in a sliding window and row_proc is called for each row.
+//Cells aren't stored in the parser, so memory use depends on the longest row and not on file size.
+N1_CSV_STATIC_API void n1_csv_parse_stream(n1_CSV_Parser* parser,
+                                           char delim_token,
+                                           char quote_token,
+                                           char row_token,
+                                           n1_CSV_RowProc row_proc,
+                                           void* user_data);
+
 /* IMPLEMENTATION */
 
 //Before including this file, define N1_CSV_IMPLEMENTATION in one file to api definitions
@@ -83,24 +350,64 @@ N1_CSV_STATIC_API void n1_csv_parse_threaded_avx256(n1_CSV_Parser* parser,
 #define N1_CSV_FALSE (0)
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <immintrin.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
 #if defined(__linux__)
 
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
+#include <errno.h>
+
+//fcntl.h declares it only with _GNU_SOURCE. Its value differs between architectures,
+//so it's only filled in on x86 and direct reads are off elsewhere without it.
+#if !defined(O_DIRECT) && (defined(__x86_64__) || defined(__i386__))
+#define O_DIRECT 040000
+#endif
+
+//define N1_CSV_NO_IO_URING to always read with pread
+#if !defined(N1_CSV_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define N1_CSV_HAS_IO_URING
+#endif
+#endif
+
+//define N1_CSV_NO_MAPPED_BUFFERS to allocate every buffer with n1_csv_malloc. Buffers aren't mapped either
+//when the allocator is replaced, the defaults below aren't defined yet.
+#if !defined(N1_CSV_NO_MAPPED_BUFFERS) && !defined(n1_csv_malloc) && !defined(n1_csv_realloc) && !defined(n1_csv_free)
+#include <sys/syscall.h>
+#define N1_CSV_HAS_MAPPED_BUFFERS
+
+//sys/mman.h declares mremap only with _GNU_SOURCE, buffers are grown with the syscall
+#ifndef MREMAP_MAYMOVE
+#define MREMAP_MAYMOVE 1
+#endif
+#endif
 
 #elif defined(_WIN32)
 
 #include <windows.h>
+#include <io.h>
 #include "Shlwapi.h"
 
 #endif
 
-
+//define n1_csv_malloc, n1_csv_realloc and n1_csv_free to replace the allocator. Large buffers are
+//then allocated with them too instead of being mapped.
 #ifndef n1_csv_malloc
 #include <stdlib.h>
 #define n1_csv_malloc malloc
@@ -119,17 +426,152 @@ N1_CSV_STATIC_API void n1_csv_parse_threaded_avx256(n1_CSV_Parser* parser,
 #define n1_memset memset
 #endif
 
+//SIMD kernels are compiled for their own instruction set, so the header builds without -mavx2
+//and the kernel is picked at runtime. MSVC allows any intrinsic without flags.
+#if defined(_MSC_VER)
+#define N1_CSV_TARGET(isa)
+#else
+#define N1_CSV_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(_MSC_VER)
+#define n1_csv_atomic_load(ptr)         InterlockedCompareExchange64((volatile LONG64*)(ptr), 0, 0)
+#define n1_csv_atomic_store(ptr, value) InterlockedExchange64((volatile LONG64*)(ptr), (LONG64)(value))
+#define n1_csv_atomic_compare_exchange(ptr, expected, desired) (InterlockedCompareExchange64((volatile LONG64*)(ptr), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#define n1_csv_atomic_fence()           MemoryBarrier()
+#else
+#define n1_csv_atomic_load(ptr)         __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define n1_csv_atomic_store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define n1_csv_atomic_compare_exchange(ptr, expected, desired) __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define n1_csv_atomic_fence()           __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+//Threaded parses split the file into morsels between these sizes, about N1_CSV_MORSELS_PER_THREAD per worker.
+//At most N1_CSV_MORSELS_PER_THREAD morsels per worker are in flight, which bounds the memory used by tokens.
+#ifndef N1_CSV_MIN_MORSEL_SIZE
+#define N1_CSV_MIN_MORSEL_SIZE (256 * 1024)
+#endif
+
+#ifndef N1_CSV_MAX_MORSEL_SIZE
+#define N1_CSV_MAX_MORSEL_SIZE (1024 * 1024)
+#endif
+
+#ifndef N1_CSV_MORSELS_PER_THREAD
+#define N1_CSV_MORSELS_PER_THREAD 8
+#endif
+
+//bytes tokenized at a time by n1_csv_parse_stream
+#ifndef N1_CSV_STREAM_WINDOW_SIZE
+#define N1_CSV_STREAM_WINDOW_SIZE (1024 * 1024)
+#endif
+
+//index files hash N1_CSV_INDEX_HASH_BLOCKS blocks spread over the file, including the first and last one
+#ifndef N1_CSV_INDEX_HASH_BLOCKS
+#define N1_CSV_INDEX_HASH_BLOCKS 16
+#endif
+
+#ifndef N1_CSV_INDEX_HASH_BLOCK_SIZE
+#define N1_CSV_INDEX_HASH_BLOCK_SIZE 4096
+#endif
+
+#define N1_CSV_INDEX_VERSION 2
+
+//page cache of parsers that read the file page by page, see n1_csv_set_page_cache
+#ifndef N1_CSV_PAGE_CACHE_BLOCK_SIZE
+#define N1_CSV_PAGE_CACHE_BLOCK_SIZE 4096
+#endif
+
+#ifndef N1_CSV_PAGE_CACHE_SIZE
+#define N1_CSV_PAGE_CACHE_SIZE (4 * 1024 * 1024)
+#endif
+
+#ifndef N1_CSV_PAGE_READ_AHEAD
+#define N1_CSV_PAGE_READ_AHEAD 15
+#endif
+
+//sections of parsers that read the file page by page are read in blocks of N1_CSV_READ_BLOCK_SIZE, with up to
+//N1_CSV_READ_QUEUE_DEPTH blocks read ahead on io_uring. See n1_csv_set_io
+#ifndef N1_CSV_READ_BLOCK_SIZE
+#define N1_CSV_READ_BLOCK_SIZE (128 * 1024)
+#endif
+
+#ifndef N1_CSV_READ_QUEUE_DEPTH
+#define N1_CSV_READ_QUEUE_DEPTH 4
+#endif
+
+#define N1_CSV_MAX_READ_QUEUE_DEPTH 32
+
+//setting up a ring and registering its buffers takes a few hundred microseconds, smaller files are read with pread
+#ifndef N1_CSV_URING_MIN_FILE_SIZE
+#define N1_CSV_URING_MIN_FILE_SIZE (8 * 1024 * 1024)
+#endif
+
+//readers kept by a parser, workers past this read the old way
+#define N1_CSV_MAX_READERS 64
+
+//Cell, row and token buffers of at least N1_CSV_MAPPED_BUFFER_SIZE bytes are mapped with huge pages on linux
+//and grow with mremap, which moves their pages instead of copying them.
+#ifndef N1_CSV_MAPPED_BUFFER_SIZE
+#define N1_CSV_MAPPED_BUFFER_SIZE (2 * 1024 * 1024)
+#endif
+
+//Parses of files of at least N1_CSV_ESTIMATE_MIN_FILE_SIZE count the tokens in the first N1_CSV_ESTIMATE_SAMPLE_SIZE
+//bytes, and reserve buffers for the whole file from them instead of growing them as they go.
+#ifndef N1_CSV_ESTIMATE_SAMPLE_SIZE
+#define N1_CSV_ESTIMATE_SAMPLE_SIZE (64 * 1024)
+#endif
+
+#ifndef N1_CSV_ESTIMATE_MIN_FILE_SIZE
+#define N1_CSV_ESTIMATE_MIN_FILE_SIZE (4 * 1024 * 1024)
+#endif
+
+//free buffers kept by an arena, the smallest one is freed when another is given back to a full arena
+#define N1_CSV_MAX_ARENA_BUFFERS 32
+
+//bytes tokenized at a time when a row of N1_CSV_CELL_LAYOUT_SPARSE is split, at least
+#ifndef N1_CSV_SPLIT_SIZE
+#define N1_CSV_SPLIT_SIZE 256
+#endif
+
 /* INTERNAL STRUCT & ENUM DEFINITIONS */
 
+//Tokenizers resolve quotes themselves and only emit delimiters and row separators
+//that end a cell, so there is no quote token.
 typedef enum N1_CSV_TOKEN_TYPE{
   N1_CSV_TOKEN_TYPE_INVALID = 0,
   N1_CSV_TOKEN_TYPE_DELIM,
-  N1_CSV_TOKEN_TYPE_QUOTE,
   N1_CSV_TOKEN_TYPE_ROW,
   N1_CSV_TOKEN_TYPE_NULL,
 
+  //flag for delimiters and row separators that are inside quotes, when the stream
+  //was tokenized without knowing if it started inside quotes. See n1_CSV_TokenStream::speculative
+  N1_CSV_TOKEN_TYPE_QUOTED = 4,
+  
 } N1_CSV_TOKEN_TYPE;
 
+typedef enum N1_CSV_FILTER{
+  N1_CSV_FILTER_EQUAL = 0,
+  N1_CSV_FILTER_PREFIX,
+  N1_CSV_FILTER_RANGE,
+  N1_CSV_FILTER_IN,
+} N1_CSV_FILTER;
+
+typedef struct n1_CSV_Filter{
+  N1_CSV_FILTER type;
+  uint32_t      column;
+
+  //N1_CSV_FILTER_RANGE
+  double        min;
+  double        max;
+
+  //other filters, stored in the same allocation as the filter
+  n1_CSV_String* values;
+  uint32_t       value_count;
+  
+} n1_CSV_Filter;
+
+//Offsets are relative to the start of the row the cell is on, see n1_CSV_Parser::row_offsets.
+//This keeps cells at 8 bytes for files larger than 4 GiB, as long as a single row is smaller than that.
 typedef struct n1_CSV_Cell{
   uint32_t start;
   uint32_t end;  
@@ -149,31 +591,288 @@ typedef struct n1_CSV_CellPage{
   
 } n1_CSV_CellPage;
 
+//Block of the file in the page cache
+typedef struct n1_CSV_CachePage{
+  //block index, UINT64_MAX when empty
+  uint64_t block;
+  char*    data;
+
+  //next page in the same bucket, -1 at the end
+  int32_t  next;
+  int8_t   referenced;
+  
+} n1_CSV_CachePage;
+
+typedef struct n1_CSV_PageCache{
+  n1_CSV_CachePage* pages;
+  uint32_t          page_count;
+  char*             data;
+
+  //pages by block index & bucket_mask
+  int32_t*          buckets;
+  uint32_t          bucket_mask;
+
+  uint32_t          clock_hand;
+  uint32_t          last_page;
+
+  //block after the last block read, read ahead from if the next miss is on it
+  uint64_t          next_block;
+
+  //cells that cross blocks are copied together
+  char*             span;
+  size_t            max_span;
+
+  uint64_t          hits;
+  uint64_t          misses;
+  
+} n1_CSV_PageCache;
+
+//Submission and completion queues of an io_uring instance, fd is -1 without one
+typedef struct n1_CSV_Ring{
+  int       fd;
+  uint32_t  entries;
+  uint32_t  pending;
+  
+#if defined(N1_CSV_HAS_IO_URING)
+  uint32_t* sq_head;
+  uint32_t* sq_tail;
+  uint32_t* sq_mask;
+  uint32_t* sq_array;
+  struct io_uring_sqe* sqes;
+
+  uint32_t* cq_head;
+  uint32_t* cq_tail;
+  uint32_t* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  void*     sq_ring;
+  size_t    sq_ring_size;
+  void*     cq_ring;
+  size_t    cq_ring_size;
+#endif
+  
+} n1_CSV_Ring;
+
+//Reads a section of the file block by block for a worker. Blocks are read in order into depth buffers,
+//which are registered with the ring. Without a ring each block is read with pread when it is needed.
+typedef struct n1_CSV_Reader{
+  uint32_t    index;
+  
+#if defined(__linux__)
+  int         file;
+#elif defined(_WIN32)
+  HANDLE      file;
+#endif
+  int8_t      direct;
+  
+  n1_CSV_Ring ring;
+  int8_t      registered;
+
+  char*       buffers;
+  size_t      block_size;
+  uint32_t    depth;
+
+  //file offset and size of the read into each buffer and the bytes read, N1_CSV_READ_IN_FLIGHT until it completes
+  uint64_t    offsets[N1_CSV_MAX_READ_QUEUE_DEPTH];
+  size_t      sizes[N1_CSV_MAX_READ_QUEUE_DEPTH];
+  int64_t     results[N1_CSV_MAX_READ_QUEUE_DEPTH];
+
+  //next buffer returned, buffers queued and submitted reads that haven't completed
+  uint32_t    head;
+  uint32_t    queued;
+  uint32_t    outstanding;
+
+  //buffer returned last, read into again by the next call. -1 if there is none
+  int32_t     returned;
+
+  //section being read, next_offset is where the next block is queued from. Reads stop at read_end,
+  //the end rounded up to a page for O_DIRECT
+  uint64_t    start;
+  uint64_t    end;
+  uint64_t    read_end;
+  uint64_t    next_offset;
+  uint64_t    file_size;
+  
+} n1_CSV_Reader;
+
+#define N1_CSV_READ_IN_FLIGHT INT64_MIN
+
+//Cells of the last row split for N1_CSV_CELL_LAYOUT_SPARSE, relative to row_start
+typedef struct n1_CSV_SplitRow{
+  uint32_t      row;
+  int8_t        valid;
+  uint64_t      row_start;
+  
+  n1_CSV_Cell*  cells;
+  uint32_t      cell_count;
+  uint32_t      max_cells;
+
+  //bytes of the file from data_start when it is read page by page
+  char*         data;
+  uint64_t      data_start;
+  size_t        max_data;
+
+  struct n1_CSV_Token* tokens;
+  uint64_t      max_tokens;
+
+  //tokens of the parse
+  char          delim_token, quote_token, row_token;
+  
+} n1_CSV_SplitRow;
+
+//Cell of a batch fetch, sorted by key to read the file in order
+typedef struct n1_CSV_BatchCell{
+  //row << 32 | column
+  uint64_t key;
+  uint32_t length;
+
+  //position in the caller's array
+  uint64_t index;
+
+  //where the cell was read to in n1_CSV_Batch::data
+  uint64_t offset;
+  
+} n1_CSV_BatchCell;
+
+//Bytes of the file read for nearby cells of a batch
+typedef struct n1_CSV_BatchRange{
+  uint64_t start;
+  size_t   size;
+  size_t   data_offset;
+
+  //bytes read, cells past them couldn't be read
+  size_t   bytes_read;
+} n1_CSV_BatchRange;
+
+typedef struct n1_CSV_Batch{
+  n1_CSV_BatchCell* cells;
+  uint64_t          max_cells;
+
+  n1_CSV_BatchRange* ranges;
+  uint64_t           max_ranges;
+
+  //bytes the cells point into when the file is read page by page
+  char*             data;
+  size_t            max_data;
+  
+} n1_CSV_Batch;
+
 typedef struct n1_CSV_Parser{
   char* filename;
 
   size_t file_size;
 
+  //file contents when the parser was created with n1_create_csv_parser_mapped,
+  //from a buffer or from an fd. NULL when the file is read page by page.
+  //Only data_size bytes can be read, the rest up to file_size is tokenized as zeros.
+  char*  file_data;
+  size_t data_size;
+  size_t mapped_size;
+
+  //file_data was read from a pipe or socket and is freed with the parser
+  int8_t owns_data;
+#if defined(_WIN32)
+  HANDLE file_mapping;
+#endif
+
   uint32_t row_count;
   uint32_t column_count;
   uint64_t cell_count;
+
+  uint64_t max_cells;
+  uint64_t max_rows;
   
   n1_CSV_Cell*     cell_data;
-  
+
+  //file offset of the first byte of each row
+  uint64_t*        row_offsets;
+
+  //cells by column when cell_layout is N1_CSV_CELL_LAYOUT_COLUMNS, cell_data is freed after parsing.
+  //column_count + 1 arrays of column_stride row relative starts, the last one has the end of each row + 1.
+  uint32_t*        column_data;
+  uint32_t         column_stride;
+  uint32_t         cell_layout;
+
+  //row_offsets holds every row_interval-th row when the last parse used N1_CSV_CELL_LAYOUT_SPARSE, 0 otherwise.
+  //cell_data is freed and cells are counted only.
+  uint32_t         row_interval;
+  uint32_t         row_sampling;
+  n1_CSV_SplitRow  split_row;
+  n1_CSV_Batch     batch;
+
+  n1_CSV_ThreadPool* thread_pool;
+  n1_CSV_Arena*      arena;
+
+  //page of the last cell read when page_cache is off
   n1_CSV_CellPage  cell_page;
+  n1_CSV_PageCache page_cache;
+  size_t           cache_size;
+  uint32_t         read_ahead;
+
+  //readers of workers tokenizing the file page by page, reader_busy[i] is set while readers[i] is used
+  n1_CSV_Reader*   readers[N1_CSV_MAX_READERS];
+  int64_t          reader_busy[N1_CSV_MAX_READERS];
+  N1_CSV_IO        io;
+  uint32_t         queue_depth;
+  int8_t           io_direct;
+  size_t           read_block_size;
+
+  //columns to store, column_mask[i] is set if column i is selected and columns past column_mask_size
+  //aren't. NULL stores every column. column_names are resolved into column_mask when a parse starts.
+  uint8_t*         column_mask;
+  uint32_t         column_mask_size;
+  char**           column_names;
+  uint32_t         column_name_count;
+  
+  //column of the next cell on the current row
+  uint32_t         row_column;
+
+  //rows have to pass every filter. filter_quote_token is set when a parse starts.
+  n1_CSV_Filter**  filters;
+  uint32_t         filter_count;
+  char             filter_quote_token;
+
+  //bytes the filters read during a parse, file_data or a mapping made for the parse when the file is
+  //read page by page. filter_mapped_size is set for such a mapping.
+  char*            filter_data;
+  size_t           filter_data_size;
+  size_t           filter_mapped_size;
+#if defined(_WIN32)
+  HANDLE           filter_mapping;
+#endif
+  
+  //current row failed a filter, its cells start at row_first_cell
+  int8_t           row_rejected;
+  uint64_t         row_first_cell;
+
+  //index file mapped by n1_csv_load_index. cell_data, row_offsets and column_data point into it.
+  char*            index_data;
+  size_t           index_size;
+#if defined(_WIN32)
+  HANDLE           index_mapping;
+#endif
   
 } n1_CSV_Parser;
 
+//N1_CSV_TOKEN_TYPE packed with a 61 bit file offset
 typedef struct n1_CSV_Token{
-  N1_CSV_TOKEN_TYPE type;
-  uint32_t          offset;  
+  uint64_t type   : 3;
+  uint64_t offset : 61;
 
 } n1_CSV_Token;
 
 typedef struct n1_CSV_TokenStream{
-  uint32_t      token_count;
-  uint32_t      max_tokens;
+  uint64_t      token_count;
+  uint64_t      max_tokens;
   n1_CSV_Token* tokens;
+
+  //all bits set while inside quotes. Starts at 0, so after tokenizing a section
+  //this is its quote parity assuming it started outside quotes.
+  uint64_t      quote_carry;
+
+  //stream doesn't start at the beginning of the file, so quoted delimiters and row separators
+  //are also emitted with N1_CSV_TOKEN_TYPE_QUOTED in case the section actually started inside quotes.
+  int8_t        speculative;
   
 } n1_CSV_TokenStream;
 
@@ -184,708 +883,5320 @@ typedef struct n1_CSV_ParseInfo{
   n1_CSV_TokenStream tokens;
   char               delim_token, quote_token, row_token;
   void (*tokenize_proc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t);
+
+  //quote state at the start of the section, resolved in order after every earlier section is tokenized
+  uint64_t                 quote_flag;
+  
+  //tokens up to the first row separator belong to a row that started in an earlier section.
+  //They are parsed while merging, so every worker builds whole rows into section
+  //starting from the first row separator in its own section.
+  uint64_t                 leading_token_count;
+  int8_t                   has_row_start;
+  n1_CSV_Parser            section;
+  int8_t                   reached_end;
+
+  //start of the last cell of the unfinished last row, merging continues from it
+  uint64_t                 cell_start;
+
+  //set by pool workers when the tokenize and parse tasks of the section are done
+  int64_t                  tokenized;
+  int64_t                  parsed;
  
 } n1_CSV_ParseInfo;
 
+//Tasks are a pointer to the parse info of a section, with the low bit telling what to do with it
+typedef enum N1_CSV_TASK{
+  N1_CSV_TASK_TOKENIZE = 0,
+  N1_CSV_TASK_PARSE    = 1,
+  
+  N1_CSV_TASK_NONE     = -1,
+  //steal lost a race, the deque may still have tasks
+  N1_CSV_TASK_RETRY    = -2,
+} N1_CSV_TASK;
+
+//Instruction sets the tokenizers need, see n1_csv_get_cpu_features
+typedef enum N1_CSV_CPU_FEATURE{
+  N1_CSV_CPU_FEATURE_SSE2     = 1 << 0,
+  N1_CSV_CPU_FEATURE_PCLMUL   = 1 << 1,
+  N1_CSV_CPU_FEATURE_AVX2     = 1 << 2,
+  N1_CSV_CPU_FEATURE_AVX512BW = 1 << 3,
+
+  //set once the cpu has been queried
+  N1_CSV_CPU_FEATURE_DETECTED = 1 << 31,
+} N1_CSV_CPU_FEATURE;
+
+//Chase-Lev work stealing deque. The owner pushes and pops at the bottom, other threads steal from the top.
+//Deques are emptied between parses, so tasks never wrap around.
+typedef struct n1_CSV_TaskDeque{
+  int64_t  top;
+  int64_t  bottom;
+  int64_t* tasks;
+  int64_t  max_tasks;
+  
+} n1_CSV_TaskDeque;
+
+typedef struct n1_CSV_Worker{
+  struct n1_CSV_ThreadPool* pool;
+  uint32_t                  index;
+
+  //first tokenize tasks of a parse, filled before the workers are woken
+  n1_CSV_TaskDeque          deque;
+  
+} n1_CSV_Worker;
+
+typedef struct n1_CSV_ThreadPool{
+  uint32_t thread_count;
+  
+#if defined(__linux__)
+  pthread_t*      threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t  job_ready;
+  pthread_cond_t  job_done;
+  pthread_mutex_t parse_mutex;
+#elif defined(_WIN32)
+  HANDLE*            threads;
+  CRITICAL_SECTION   mutex;
+  CONDITION_VARIABLE job_ready;
+  CONDITION_VARIABLE job_done;
+  CRITICAL_SECTION   parse_mutex;
+#endif
+
+  n1_CSV_Worker*     workers;
+  
+  //pushed by the merging thread. Parse tasks once a section is resolved and
+  //tokenize tasks for new sections once merged sections free their infos.
+  n1_CSV_TaskDeque   tasks;
+
+  //workers only touch the deques while a parse is running. epoch is bumped when new tasks are pushed.
+  int8_t             running;
+  int8_t             shutdown;
+  uint64_t           epoch;
+  uint32_t           active_workers;
+
+  //tasks finished during the current parse
+  int64_t            completed;
+
+  //ring of sections in flight, reused between parses so buffers keep their capacity
+  n1_CSV_ParseInfo*  infos;
+  uint32_t           max_infos;
+  
+} n1_CSV_ThreadPool;
+
+typedef struct n1_CSV_ArenaBuffer{
+  void*  data;
+  size_t size;
+  
+} n1_CSV_ArenaBuffer;
+
+typedef struct n1_CSV_Arena{
+#if defined(__linux__)
+  pthread_mutex_t    mutex;
+#elif defined(_WIN32)
+  CRITICAL_SECTION   mutex;
+#endif
+
+  n1_CSV_ArenaBuffer buffers[N1_CSV_MAX_ARENA_BUFFERS];
+  uint32_t           buffer_count;
+  
+} n1_CSV_Arena;
+
+typedef struct n1_CSV_StreamState{
+  n1_CSV_RowProc row_proc;
+  void*          user_data;
+  
+  //bytes of the file starting from data_offset, either the mapped file or the window
+  char*          data;
+  uint64_t       data_offset;
+
+  uint64_t       row;
+  uint64_t       row_start;
+  uint64_t       cell_start;
+  
+  //cells of the current row as file offsets, converted to strings when the row is complete
+  uint64_t*      cell_offsets;
+  n1_CSV_String* cells;
+  uint32_t       cell_count;
+  uint32_t       max_cells;
+  
+} n1_CSV_StreamState;
+
+typedef struct n1_CSV_HeaderMatch{
+  n1_CSV_Parser* parser;
+  char           quote_token;
+} n1_CSV_HeaderMatch;
+
+//Start of an index file. Followed by row_count row offsets and then cell_count cells, or
+//column_count + 1 columns of row_count starts for N1_CSV_CELL_LAYOUT_COLUMNS. Sparse layouts
+//have one row offset per row_interval rows and no cells.
+typedef struct n1_CSV_IndexHeader{
+  char     magic[8];
+  uint32_t version;
+  uint32_t cell_layout;
+
+  //of the file when it was parsed, file_size isn't padded
+  uint64_t file_size;
+  int64_t  file_time;
+  uint64_t file_hash;
+  uint64_t settings_hash;
+
+  //row offsets are sampled for N1_CSV_CELL_LAYOUT_SPARSE and there are no cells
+  uint64_t row_interval;
+  
+  uint64_t cell_count;
+  uint32_t row_count;
+  uint32_t column_count;
+  char     delim_token, quote_token, row_token;
+  char     padding[13];
+  
+} n1_CSV_IndexHeader;
+
 /* INTERNAL FUNCTION DECLARAATIONS */
 
 static void n1_csv_maybe_realloc_cell_data(n1_CSV_Parser* parser);
 
-static void n1_csv_maybe_realloc_token_stream(n1_CSV_TokenStream* tokens);
+static void n1_csv_maybe_realloc_row_offsets(n1_CSV_Parser* parser);
 
-static size_t n1_csv_get_page_size();
+//allocates cell_data and row_offsets and starts the first row at offset 0
+static void n1_csv_init_cell_data(n1_CSV_Parser* parser);
 
-static uint32_t n1_csv_get_processor_count();
+//Resizes a buffer of size bytes to new_size bytes. Buffers smaller than N1_CSV_MAPPED_BUFFER_SIZE are n1_csv_malloc'd
+//and larger ones mapped, so a buffer that can grow that large is freed with n1_csv_free_buffer and the size it last had.
+static void* n1_csv_resize_buffer(void* data, size_t size, size_t new_size);
 
-//threadproc for tokenizing section of a file.
-static void n1_csv_tokenize_paged(n1_CSV_ParseInfo* parse_info);
+static void n1_csv_free_buffer(void* data, size_t size);
 
-static void n1_csv_tokenize_slow(n1_CSV_Parser* parser,
-                                 n1_CSV_TokenStream* tokens,
-                                 char delim_token,
-                                 char quote_token,
-                                 char row_token,
-                                 char* file_buffer,
-                                 size_t offset,
-                                 size_t bytes_to_read);
+//Takes the smallest free buffer of at least min_size bytes from arena, or its largest one if none is that large,
+//and sets size to its size. NULL without an arena or free buffers.
+static void* n1_csv_take_buffer(n1_CSV_Arena* arena, size_t min_size, size_t* size);
 
-static void n1_csv_tokenize_sse2(n1_CSV_Parser* parser,
-                                 n1_CSV_TokenStream* tokens,
-                                 char delim_token,
-                                 char quote_token,
-                                 char row_token,
-                                 char* file_buffer,
-                                 size_t offset,
-                                 size_t bytes_to_read);
+//gives a buffer back to arena, or frees it without one
+static void n1_csv_give_buffer(n1_CSV_Arena* arena, void* data, size_t size);
 
-static void n1_csv_tokenize_avx256(n1_CSV_Parser* parser,
-                                   n1_CSV_TokenStream* tokens,
-                                   char delim_token,
-                                   char quote_token,
-                                   char row_token,
-                                   char* file_buffer,
-                                   size_t offset,
-                                   size_t bytes_to_read);
+//Grows data to at least count elements of element_size by doubling capacity, which is updated. Without data
+//a buffer is taken from arena first.
+static void* n1_csv_reserve_buffer(n1_CSV_Arena* arena, void* data, uint64_t* capacity, uint64_t count, size_t element_size);
 
-//Convert tokens into cells.
-static int8_t n1_csv_parse_tokens(n1_CSV_Parser* parser,
-                                  uint32_t token_count,
-                                  n1_CSV_Token* tokens,
-                                  n1_CSV_Token* prev_token,
-                                  int8_t* is_quoted,
-                                  uint32_t* cell_start,
-                                  uint32_t* row_idx,
-                                  int* start_quote_count,
-                                  int* end_quote_count,
-                                  int8_t* is_start_of_cell);
-
-//Called from main API parse function with a tokenizer threadproc
-//after file has been tokenized, n1_csv_parse_tokens is called.
-static void n1_csv_parse_threaded(n1_CSV_Parser* parser,
-                                  char delim_token,
-                                  char quote_token,
-                                  char row_token,
-                                  void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t));
+//Delimiters and row separators in the first N1_CSV_ESTIMATE_SAMPLE_SIZE bytes, scaled to the whole file.
+//Quoted ones are counted too. 0 for files smaller than N1_CSV_ESTIMATE_MIN_FILE_SIZE.
+static void n1_csv_estimate_token_count(n1_CSV_Parser* parser,
+                                        char delim_token,
+                                        char row_token,
+                                        uint64_t* token_count,
+                                        uint64_t* row_count);
 
+//reserves cell_data and row_offsets for a file estimated to have token_count tokens and row_count rows
+static void n1_csv_reserve_estimate(n1_CSV_Parser* parser, uint64_t token_count, uint64_t row_count);
 
-/* INTERNAL FUNCTION DEFINITIONS */
+//row_proc for n1_csv_parse_stream, selects the columns of the first row that match column_names
+static int n1_csv_match_header(void* user_data, uint64_t row, n1_CSV_String* cells, uint32_t cell_count);
 
-static void n1_csv_maybe_realloc_cell_data(n1_CSV_Parser* parser){
-  
-  if(parser->cell_count == (parser->column_count * parser->row_count)){
-    parser->row_count <<= 1;
-    parser->cell_data = (n1_CSV_Cell*)n1_csv_realloc(parser->cell_data, parser->column_count * parser->row_count * sizeof(n1_CSV_Cell));
+//reads the first row to build column_mask from column_names
+static void n1_csv_resolve_column_names(n1_CSV_Parser* parser,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token);
 
-    if(parser->cell_data == NULL){
-      perror("realloc cell_data:");
-    }
-  }
-}
+//adds a filter with room for values of values_size bytes after it
+static n1_CSV_Filter* n1_csv_push_filter(n1_CSV_Parser* parser, N1_CSV_FILTER type, uint32_t column, uint32_t value_count, size_t values_size);
 
-static void n1_csv_maybe_realloc_token_stream(n1_CSV_TokenStream* tokens){
-  
-  if(tokens->token_count >= tokens->max_tokens){
-    tokens->max_tokens <<= 1;
-    tokens->tokens = (n1_CSV_Token*)n1_csv_realloc(tokens->tokens, tokens->max_tokens * sizeof(n1_CSV_Token));
+//sets the bytes the filters read, mapping the file if it isn't in memory. FALSE if it can't be mapped.
+static int8_t n1_csv_prepare_filters(n1_CSV_Parser* parser, char quote_token);
 
-    if(tokens->tokens == NULL){ //failed to realloc
-      perror("realloc token stream: ");
-    }    
-  }
-}
+//unmaps what n1_csv_prepare_filters mapped, so paged parsers are left as they were
+static void n1_csv_release_filters(n1_CSV_Parser* parser);
 
-static size_t n1_csv_get_page_size(){
+//compares value with a quoted cell whose doubled quotes are read as one. With prefix,
+//value only has to match the start of the cell.
+static int8_t n1_csv_unescaped_equal(n1_CSV_String cell, n1_CSV_String value, char quote_token, int8_t prefix);
 
-  static size_t page_size;
+//compares length bytes 16 at a time
+static int8_t n1_csv_bytes_equal(const char* a, const char* b, uint32_t length);
 
-  if(!page_size){
-#if defined(__linux__)
+//checks the cell from start to end against the filters of the current column
+static int8_t n1_csv_check_filters(n1_CSV_Parser* parser, uint64_t start, uint64_t end);
 
-    page_size = sysconf(_SC_PAGESIZE);
+//drops the cells of the current row if it failed a filter
+static void n1_csv_end_row(n1_CSV_Parser* parser);
 
-#elif defined(_WIN32)
+//stores cell relative to the current row
+static void n1_csv_push_cell(n1_CSV_Parser* parser, uint64_t start, uint64_t end);
 
-    SYSTEM_INFO system_info;
-    GetSystemInfo(&system_info);
-    page_size = system_info.dwPageSize;
+//moves cells of the rows from first_row on into column_data if the parser uses N1_CSV_CELL_LAYOUT_COLUMNS.
+//cell_data holds only those rows, first_cell is the index of the first one.
+//N1_CSV_CELL_LAYOUT_SPARSE frees cell_data and samples row_offsets instead.
+static void n1_csv_store_columns(n1_CSV_Parser* parser, uint32_t first_row, uint64_t first_cell);
 
-#endif
-  }
+//interval rows are sampled at by the following parse, 0 unless the parser uses N1_CSV_CELL_LAYOUT_SPARSE
+static uint32_t n1_csv_get_row_interval(n1_CSV_Parser* parser);
 
-  return page_size;
-}
-static uint32_t n1_csv_get_processor_count(){
-  static uint32_t processor_count;
+//number of entries in row_offsets
+static uint32_t n1_csv_get_row_offset_count(n1_CSV_Parser* parser);
 
-  if(!processor_count){
+//keeps every row_interval-th row offset and frees cell_data
+static void n1_csv_sample_rows(n1_CSV_Parser* parser);
 
-#if defined(__linux__)
-    processor_count = get_nprocs();    
-#elif defined(_WIN32)
-    processor_count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
-#endif
-  }
-  return processor_count;
-}
-static void n1_csv_tokenize_paged(n1_CSV_ParseInfo* parse_info){
+//tokens rows are split with, the split row is invalid after a parse
+static void n1_csv_init_split_row(n1_CSV_Parser* parser, char delim_token, char quote_token, char row_token);
 
-  n1_CSV_Parser*      parser = parse_info->parser;
-  n1_CSV_TokenStream* tokens = &parse_info->tokens;
-  
-  size_t offset    = parse_info->file_offset;
-  size_t page_size = n1_csv_get_page_size();
+//reads size bytes at offset from the file with the handle of cell_page. Returns the bytes read.
+static size_t n1_csv_read_file_at(n1_CSV_Parser* parser, char* buffer, uint64_t offset, size_t size);
+
+//tokenizes forward from the closest sampled row and stores the selected cells of row in split_row
+static void n1_csv_split_row(n1_CSV_Parser* parser, uint32_t row);
+
+//allocates cache_size bytes of pages
+static void n1_csv_init_page_cache(n1_CSV_Parser* parser);
+
+//empties the cache, pages are kept
+static void n1_csv_clear_page_cache(n1_CSV_Parser* parser);
+
+static void n1_csv_destroy_page_cache(n1_CSV_Parser* parser);
+
+//picks the next page without the referenced bit and takes it out of its bucket
+static n1_CSV_CachePage* n1_csv_evict_page(n1_CSV_PageCache* cache);
+
+//data of block, read with the blocks after it on sequential misses. NULL if the block can't be read.
+static char* n1_csv_get_cached_block(n1_CSV_Parser* parser, uint64_t block);
+
+//bytes from start to end from the page cache. NULL if the cache is off or the bytes can't be read.
+static char* n1_csv_read_cached(n1_CSV_Parser* parser, uint64_t start, uint64_t end);
+
+//sets up an io_uring instance with entries submission entries. Returns 0 if the kernel doesn't allow it.
+static int8_t n1_csv_init_ring(n1_CSV_Ring* ring, uint32_t entries);
+
+static void n1_csv_destroy_ring(n1_CSV_Ring* ring);
+
+//queues a read of size bytes at offset into buffer, buffer_index is the registered buffer or -1
+static void n1_csv_ring_read(n1_CSV_Ring* ring, int file, char* buffer, uint32_t size, uint64_t offset, uint64_t user_data, int32_t buffer_index);
+
+//submits queued reads and waits until wait_count of them complete. On errors other than EINTR the ring is
+//destroyed, reads in flight are lost and 0 is returned.
+static int8_t n1_csv_ring_submit(n1_CSV_Ring* ring, uint32_t wait_count);
+
+//pops a completed read. Returns 0 if none has completed or the ring was destroyed.
+static int8_t n1_csv_ring_complete(n1_CSV_Ring* ring, uint64_t* user_data, int64_t* result);
+
+//reader nobody is using, created on first use. NULL if they are all taken or the file can't be opened.
+static n1_CSV_Reader* n1_csv_acquire_reader(n1_CSV_Parser* parser);
+
+static void n1_csv_release_reader(n1_CSV_Parser* parser, n1_CSV_Reader* reader);
+
+static n1_CSV_Reader* n1_csv_create_reader(n1_CSV_Parser* parser);
+
+static void n1_csv_destroy_readers(n1_CSV_Parser* parser);
+
+//blocking read with the reader's file, returns the bytes read
+static size_t n1_csv_reader_read_at(n1_CSV_Reader* reader, char* buffer, uint64_t offset, size_t size);
+
+//starts reading bytes from start to end, queueing the first depth blocks
+static void n1_csv_start_reader(n1_CSV_Reader* reader, uint64_t start, uint64_t end);
+
+//queues a read of the next block of the section into buffer
+static void n1_csv_queue_block(n1_CSV_Reader* reader, uint32_t buffer);
+
+//submits the queued blocks through the ring. If it fails, blocks in flight are marked as failed reads,
+//which are done again without the ring.
+static void n1_csv_submit_blocks(n1_CSV_Reader* reader, uint32_t wait_count);
+
+//next block of the section in order, bytes past the end of the file are zeros. The block stays valid until the
+//next call. Returns NULL at the end of the section.
+static char* n1_csv_next_block(n1_CSV_Reader* reader, uint64_t* offset, size_t* size);
+
+//file offset and length of a cell. Returns 0 if it doesn't exist.
+static int8_t n1_csv_locate_cell(n1_CSV_Parser* parser, uint32_t column, uint32_t row, uint64_t* start, uint32_t* length);
+
+static int n1_csv_compare_batch_cells(const void* a, const void* b);
+
+//fills cells from the first count cells of parser->batch, which have their key and index set.
+//sorted skips checking if they are in file order already.
+static uint64_t n1_csv_fetch_batch(n1_CSV_Parser* parser, uint64_t count, n1_CSV_String* cells, int8_t sorted);
+
+//reads the first range_count ranges of parser->batch into its data, several at a time on io_uring
+static void n1_csv_read_ranges(n1_CSV_Parser* parser, uint64_t range_count);
+
+//grows parser->batch to count cells
+static void n1_csv_reserve_batch(n1_CSV_Parser* parser, uint64_t count);
+
+static void n1_csv_push_row(n1_CSV_Parser* parser, uint64_t offset);
+
+static void n1_csv_maybe_realloc_token_stream(n1_CSV_TokenStream* tokens);
+
+//makes room for count more tokens, so SIMD tokenizers can check once per block instead of per token
+static void n1_csv_reserve_token_stream(n1_CSV_TokenStream* tokens, uint64_t count);
+
+static uint32_t n1_csv_count_trailing_zeros(uint64_t value);
+
+//bit i of result is the xor of bits 0..i, turns a quote mask into a mask of quoted bytes.
+static uint64_t n1_csv_prefix_xor(uint64_t bits);
+
+//same as n1_csv_prefix_xor with a carry-less multiply, for kernels built with pclmul
+N1_CSV_TARGET("pclmul")
+static uint64_t n1_csv_prefix_xor_clmul(uint64_t bits);
+
+//masks quoted bytes out of a 64 byte block and emits tokens for the rest.
+//quote_prefix is the prefix xor of the quote mask. Stream must have room for 64 tokens.
+static void n1_csv_emit_block(n1_CSV_TokenStream* tokens,
+                              uint64_t delim_mask,
+                              uint64_t quote_prefix,
+                              uint64_t row_mask,
+                              uint64_t null_mask,
+                              uint64_t offset);
+
+static size_t n1_csv_get_page_size();
+
+static uint32_t n1_csv_get_processor_count();
+
+//sets file_size from the size of filename
+static void n1_csv_stat_file(n1_CSV_Parser* parser);
+
+//maps filename into parser->file_data.
+static int8_t n1_csv_map_file(n1_CSV_Parser* parser);
+
+//maps an open file, which stays open
+#if defined(__linux__)
+static int8_t n1_csv_map_handle(n1_CSV_Parser* parser, int file);
+#elif defined(_WIN32)
+static int8_t n1_csv_map_handle(n1_CSV_Parser* parser, HANDLE file);
+#endif
+
+//reads an open file, pipe or socket to the end into file_data
+#if defined(__linux__)
+static int8_t n1_csv_read_handle(n1_CSV_Parser* parser, int file);
+#elif defined(_WIN32)
+static int8_t n1_csv_read_handle(n1_CSV_Parser* parser, HANDLE file);
+#endif
+
+//tokenizes file_data from offset, bytes past data_size are tokenized as zeros
+static void n1_csv_tokenize_memory(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   void (*tokenize_proc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t),
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   size_t offset,
+                                   size_t bytes_to_read);
+
+static void n1_csv_unmap_file(n1_CSV_Parser* parser);
+
+//FNV-1a
+static uint64_t n1_csv_hash_bytes(uint64_t hash, const void* data, size_t size);
+
+//size and last write time of filename, size isn't padded
+static int8_t n1_csv_get_file_info(n1_CSV_Parser* parser, uint64_t* size, int64_t* time);
+
+//hashes blocks sampled over the first size bytes of the file
+static int8_t n1_csv_hash_file(n1_CSV_Parser* parser, uint64_t size, uint64_t* hash);
+
+//hashes selected columns and filters, which change the cells a parse stores
+static uint64_t n1_csv_hash_settings(n1_CSV_Parser* parser);
+
+//fills header for the file as it is now
+static int8_t n1_csv_init_index_header(n1_CSV_Parser* parser,
+                                       n1_CSV_IndexHeader* header,
+                                       char delim_token,
+                                       char quote_token,
+                                       char row_token);
+
+//index_filename, or the file name with ".n1idx" appended. Freed by the caller.
+static char* n1_csv_get_index_filename(n1_CSV_Parser* parser, const char* index_filename);
+
+//cells of a loaded index are read only. Parses that write cells drop them, or copy them
+//into buffers of their own if keep_cells is set.
+static void n1_csv_release_index(n1_CSV_Parser* parser, int8_t keep_cells);
+
+//writes the cells of the parser after header
+static int8_t n1_csv_write_index(n1_CSV_Parser* parser, const char* index_filename, n1_CSV_IndexHeader* header);
+
+//maps the index if it starts with expected and uses its cells
+static int8_t n1_csv_map_index(n1_CSV_Parser* parser, const char* index_filename, const n1_CSV_IndexHeader* expected);
+
+//threadproc for tokenizing section of a file.
+static void n1_csv_tokenize_paged(n1_CSV_ParseInfo* parse_info);
+
+static void n1_csv_tokenize_slow(n1_CSV_Parser* parser,
+                                 n1_CSV_TokenStream* tokens,
+                                 char delim_token,
+                                 char quote_token,
+                                 char row_token,
+                                 char* file_buffer,
+                                 size_t offset,
+                                 size_t bytes_to_read);
+
+N1_CSV_TARGET("sse2")
+static void n1_csv_tokenize_sse2(n1_CSV_Parser* parser,
+                                 n1_CSV_TokenStream* tokens,
+                                 char delim_token,
+                                 char quote_token,
+                                 char row_token,
+                                 char* file_buffer,
+                                 size_t offset,
+                                 size_t bytes_to_read);
+
+N1_CSV_TARGET("avx2,pclmul")
+static void n1_csv_tokenize_avx256(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   char* file_buffer,
+                                   size_t offset,
+                                   size_t bytes_to_read);
+
+N1_CSV_TARGET("avx512f,avx512bw,pclmul")
+static void n1_csv_tokenize_avx512(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   char* file_buffer,
+                                   size_t offset,
+                                   size_t bytes_to_read);
+
+//queries the cpu once, returns N1_CSV_CPU_FEATURE flags
+static uint32_t n1_csv_get_cpu_features();
+
+//fastest tokenizer the cpu supports
+static void (*n1_csv_select_tokenizer())(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t);
+
+//Convert tokens into cells. quote_flag is N1_CSV_TOKEN_TYPE_QUOTED if the stream started inside quotes.
+//Returns N1_CSV_FALSE after the null token at the end of file.
+static int8_t n1_csv_parse_tokens(n1_CSV_Parser* parser,
+                                  uint64_t token_count,
+                                  n1_CSV_Token* tokens,
+                                  uint64_t quote_flag,
+                                  uint64_t* cell_start);
+
+//sets the quote state of a section from the quote carry of every earlier section and finds
+//the first row that starts in it. Returns the quote carry after the section.
+static uint64_t n1_csv_resolve_section(n1_CSV_ParseInfo* parse_info, uint64_t quote_carry, int8_t first_section);
+
+//builds cells for the rows that start in a resolved section, leaving the last row unfinished.
+//Section boundaries are moved forward to the first row that starts after them.
+static void n1_csv_parse_section(n1_CSV_ParseInfo* parse_info);
+
+//finishes the last row of parser with the leading tokens of a section and appends the section's rows.
+//Returns N1_CSV_FALSE after the end of file.
+static int8_t n1_csv_merge_section(n1_CSV_Parser* parser, n1_CSV_ParseInfo* parse_info, uint64_t* cell_start);
+
+static void n1_csv_append_section(n1_CSV_Parser* parser, n1_CSV_Parser* section);
+
+static void n1_csv_reset_task_deque(n1_CSV_TaskDeque* deque, int64_t max_tasks);
+
+static void n1_csv_push_task(n1_CSV_TaskDeque* deque, int64_t task);
+
+static int64_t n1_csv_pop_task(n1_CSV_TaskDeque* deque);
+
+static int64_t n1_csv_steal_task(n1_CSV_TaskDeque* deque);
+
+//pops from the worker's own deque, then steals from the merging thread and then from other workers
+static int64_t n1_csv_find_task(n1_CSV_Worker* worker);
+
+//threadproc for pool workers, runs tasks until the pool is destroyed
+static void n1_csv_thread_pool_proc(n1_CSV_Worker* worker);
+
+//makes sure the pool has parse infos for section_count sections
+static void n1_csv_thread_pool_reserve_infos(n1_CSV_ThreadPool* pool, uint32_t section_count);
+
+//splits the first sections over the worker deques and wakes the workers.
+//max_tasks is the number of tasks the merging thread pushes during the parse.
+static void n1_csv_thread_pool_start(n1_CSV_ThreadPool* pool, uint32_t section_count, int64_t max_tasks);
+
+static void n1_csv_thread_pool_notify(n1_CSV_ThreadPool* pool);
+
+//waits until a task finishes after completed was read
+static void n1_csv_thread_pool_wait(n1_CSV_ThreadPool* pool, int64_t completed);
+
+//waits until no worker is touching the deques
+static void n1_csv_thread_pool_stop(n1_CSV_ThreadPool* pool);
+
+static void n1_csv_stream_push_cell(n1_CSV_StreamState* state, uint64_t start, uint64_t end);
+
+//calls row_proc with the cells of the current row. Returns N1_CSV_FALSE if row_proc wants to stop.
+static int8_t n1_csv_stream_row(n1_CSV_StreamState* state);
+
+//Convert tokens of a window into rows. Returns N1_CSV_FALSE after the end of file or when row_proc stops.
+static int8_t n1_csv_stream_tokens(n1_CSV_StreamState* state, n1_CSV_TokenStream* tokens);
+
+//drops a trailing '\r' and surrounding quote tokens
+static void n1_csv_trim_cell(n1_CSV_String* cell, char quote_token);
+
+//SWAR digit parsing, 8 ascii digits loaded as one little endian word
+static int8_t n1_csv_is_eight_digits(uint64_t chars);
+
+static uint64_t n1_csv_parse_eight_digits(uint64_t chars);
+
+//parses unsigned digits from at, 8 at a time while possible. Stops at the first non-digit or after
+//max_digits digits. Returns the number of digits parsed.
+static uint32_t n1_csv_parse_digits(const char* at, const char* end, uint32_t max_digits, uint64_t* value);
+
+//Converters return N1_CSV_FALSE if the whole string isn't a value of their type
+static int8_t n1_csv_convert_int64(const char* at, uint32_t length, int64_t* value);
+
+//exact for up to 19 significant digits and exponents up to 22 without strtod, which handles the rest
+static int8_t n1_csv_convert_double(const char* at, uint32_t length, double* value);
+
+static int8_t n1_csv_convert_bool(const char* at, uint32_t length, uint8_t* value);
+
+static int8_t n1_csv_convert_timestamp(const char* at, uint32_t length, int64_t* value);
+
+//days from 1970-01-01 in the proleptic gregorian calendar
+static int64_t n1_csv_days_from_civil(int64_t year, uint32_t month, uint32_t day);
+
+//sets up a section for tokenizing, keeping its buffers
+static void n1_csv_init_parse_info(n1_CSV_ParseInfo* info,
+                                   n1_CSV_Parser* parser,
+                                   uint32_t section_idx,
+                                   size_t bytes_to_read,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t));
+
+//Called from main API parse function with a tokenizer threadproc.
+//Sections are tokenized and parsed on worker threads and then merged in order.
+static void n1_csv_parse_threaded(n1_CSV_Parser* parser,
+                                  char delim_token,
+                                  char quote_token,
+                                  char row_token,
+                                  void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t));
+
+
+/* INTERNAL FUNCTION DEFINITIONS */
+
+static void n1_csv_maybe_realloc_cell_data(n1_CSV_Parser* parser){
+  
+  if(parser->cell_count >= parser->max_cells){
+    parser->cell_data = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena,
+                                                            parser->cell_data,
+                                                            &parser->max_cells,
+                                                            parser->cell_count + 1,
+                                                            sizeof(n1_CSV_Cell));
+
+    if(parser->cell_data == NULL){
+      perror("realloc cell_data:");
+    }
+  }
+}
+
+static void n1_csv_maybe_realloc_row_offsets(n1_CSV_Parser* parser){
+  
+  if(parser->row_count >= parser->max_rows){
+    parser->row_offsets = (uint64_t*)n1_csv_reserve_buffer(parser->arena,
+                                                           parser->row_offsets,
+                                                           &parser->max_rows,
+                                                           (uint64_t)parser->row_count + 1,
+                                                           sizeof(uint64_t));
+
+    if(parser->row_offsets == NULL){
+      perror("realloc row_offsets:");
+    }
+  }
+}
+
+static void n1_csv_init_cell_data(n1_CSV_Parser* parser){
+
+  parser->column_count = 0;
+  parser->row_count    = 0;
+  parser->cell_count   = 0;
+
+  //keep buffers from an earlier parse
+  parser->cell_data   = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena, parser->cell_data, &parser->max_cells, 256, sizeof(n1_CSV_Cell));
+  parser->row_offsets = (uint64_t*)n1_csv_reserve_buffer(parser->arena, parser->row_offsets, &parser->max_rows, 64, sizeof(uint64_t));
+
+  n1_csv_push_row(parser, 0);
+}
+
+static void* n1_csv_resize_buffer(void* data, size_t size, size_t new_size){
+
+#if defined(N1_CSV_HAS_MAPPED_BUFFERS)
+  
+  const int8_t mapped     = data && size >= N1_CSV_MAPPED_BUFFER_SIZE;
+  const int8_t map_result = new_size >= N1_CSV_MAPPED_BUFFER_SIZE;
+
+  if(mapped || map_result){
+    void* result = NULL;
+    
+    if(mapped && map_result){
+      //moves the pages to a larger range instead of copying them
+      result = (void*)syscall(SYS_mremap, data, size, new_size, MREMAP_MAYMOVE);
+      return result == MAP_FAILED ? NULL : result;
+    }
+
+    if(map_result){
+      result = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(result == MAP_FAILED){
+        return NULL;
+      }
+#if defined(MADV_HUGEPAGE)
+      //a fault fills 2 MiB instead of 4 KiB
+      madvise(result, new_size, MADV_HUGEPAGE);
+#endif
+    }else{
+      result = n1_csv_malloc(new_size);
+    }
+    
+    if(result && data){
+      memcpy(result, data, size < new_size ? size : new_size);
+    }
+    n1_csv_free_buffer(data, size);
+    
+    return result;
+  }
+  
+#endif
+
+  return n1_csv_realloc(data, new_size);
+}
+
+static void n1_csv_free_buffer(void* data, size_t size){
+
+#if defined(N1_CSV_HAS_MAPPED_BUFFERS)
+  if(data && size >= N1_CSV_MAPPED_BUFFER_SIZE){
+    munmap(data, size);
+    return;
+  }
+#endif
+  
+  n1_csv_free(data);
+}
+
+static void* n1_csv_take_buffer(n1_CSV_Arena* arena, size_t min_size, size_t* size){
+
+  if(!arena){
+    return NULL;
+  }
+  
+#if defined(__linux__)
+  pthread_mutex_lock(&arena->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&arena->mutex);
+#endif
+
+  uint32_t best = arena->buffer_count;
+  
+  for(uint32_t i = 0; i < arena->buffer_count; i++){
+    const size_t buffer_size = arena->buffers[i].size;
+    
+    if(best == arena->buffer_count){
+      best = i;
+    }else if(buffer_size >= min_size){
+      if(arena->buffers[best].size < min_size || buffer_size < arena->buffers[best].size){
+        best = i;
+      }
+    }else if(buffer_size > arena->buffers[best].size){
+      best = i;
+    }
+  }
+
+  void* data = NULL;
+  
+  if(best < arena->buffer_count){
+    data  = arena->buffers[best].data;
+    *size = arena->buffers[best].size;
+    arena->buffers[best] = arena->buffers[--arena->buffer_count];
+  }
+  
+#if defined(__linux__)
+  pthread_mutex_unlock(&arena->mutex);
+#elif defined(_WIN32)
+  LeaveCriticalSection(&arena->mutex);
+#endif
+
+  return data;
+}
+
+static void n1_csv_give_buffer(n1_CSV_Arena* arena, void* data, size_t size){
+
+  if(!arena || !data){
+    n1_csv_free_buffer(data, size);
+    return;
+  }
+  
+#if defined(__linux__)
+  pthread_mutex_lock(&arena->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&arena->mutex);
+#endif
+
+  //full arena keeps the larger buffer of this one and its smallest
+  if(arena->buffer_count == N1_CSV_MAX_ARENA_BUFFERS){
+    uint32_t smallest = 0;
+    for(uint32_t i = 1; i < arena->buffer_count; i++){
+      if(arena->buffers[i].size < arena->buffers[smallest].size){
+        smallest = i;
+      }
+    }
+    
+    if(arena->buffers[smallest].size < size){
+      n1_CSV_ArenaBuffer evicted = arena->buffers[smallest];
+      arena->buffers[smallest].data = data;
+      arena->buffers[smallest].size = size;
+      data = evicted.data;
+      size = evicted.size;
+    }
+  }else{
+    arena->buffers[arena->buffer_count].data = data;
+    arena->buffers[arena->buffer_count].size = size;
+    arena->buffer_count++;
+    data = NULL;
+  }
+  
+#if defined(__linux__)
+  pthread_mutex_unlock(&arena->mutex);
+#elif defined(_WIN32)
+  LeaveCriticalSection(&arena->mutex);
+#endif
+
+  n1_csv_free_buffer(data, size);
+}
+
+static void* n1_csv_reserve_buffer(n1_CSV_Arena* arena, void* data, uint64_t* capacity, uint64_t count, size_t element_size){
+
+  if(!data){
+    *capacity = 0;
+    
+    size_t size = 0;
+    data = n1_csv_take_buffer(arena, count * element_size, &size);
+    if(data){
+      *capacity = size / element_size;
+    }
+  }
+  
+  if(count <= *capacity){
+    return data;
+  }
+
+  uint64_t new_capacity = *capacity ? *capacity : 1;
+  while(new_capacity < count){
+    new_capacity <<= 1;
+  }
+  
+  data      = n1_csv_resize_buffer(data, *capacity * element_size, new_capacity * element_size);
+  *capacity = data ? new_capacity : 0;
+  
+  return data;
+}
+
+static void n1_csv_estimate_token_count(n1_CSV_Parser* parser,
+                                        char delim_token,
+                                        char row_token,
+                                        uint64_t* token_count,
+                                        uint64_t* row_count){
+  
+  *token_count = 0;
+  *row_count   = 0;
+  
+  if(parser->file_size < N1_CSV_ESTIMATE_MIN_FILE_SIZE){
+    return;
+  }
+
+  const char* sample = parser->file_data;
+  char*       buffer = NULL;
+  size_t      size   = N1_CSV_ESTIMATE_SAMPLE_SIZE;
+
+  if(sample){
+    if(size > parser->data_size){
+      size = parser->data_size;
+    }
+  }else{
+    buffer = (char*)n1_csv_malloc(size);
+    size   = n1_csv_read_file_at(parser, buffer, 0, size);
+    sample = buffer;
+  }
+  
+  uint64_t delims = 0;
+  uint64_t rows   = 0;
+  
+  for(size_t i = 0; i < size; i++){
+    delims += sample[i] == delim_token;
+    rows   += sample[i] == row_token;
+  }
+  n1_csv_free(buffer);
+
+  if(size){
+    const double scale = (double)parser->file_size / (double)size;
+    *token_count = (uint64_t)((double)(delims + rows) * scale);
+    *row_count   = (uint64_t)((double)rows * scale);
+  }
+}
+
+static void n1_csv_reserve_estimate(n1_CSV_Parser* parser, uint64_t token_count, uint64_t row_count){
+
+  if(!token_count){
+    return;
+  }
+  
+  //an eighth more in case later rows are longer. Cells of sparse layouts aren't kept, and there is no telling
+  //how many cells projections and filters drop.
+  if(parser->cell_layout != N1_CSV_CELL_LAYOUT_SPARSE && !parser->column_mask && !parser->filter_count){
+    parser->cell_data = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena,
+                                                            parser->cell_data,
+                                                            &parser->max_cells,
+                                                            token_count + token_count / 8,
+                                                            sizeof(n1_CSV_Cell));
+  }
+  parser->row_offsets = (uint64_t*)n1_csv_reserve_buffer(parser->arena,
+                                                         parser->row_offsets,
+                                                         &parser->max_rows,
+                                                         row_count + row_count / 8,
+                                                         sizeof(uint64_t));
+}
+
+static void n1_csv_store_columns(n1_CSV_Parser* parser, uint32_t first_row, uint64_t first_cell){
+
+  parser->row_interval = 0;
+  
+  if(parser->cell_layout != N1_CSV_CELL_LAYOUT_COLUMNS){
+    //left from an earlier parse
+    n1_csv_free(parser->column_data);
+    parser->column_data   = NULL;
+    parser->column_stride = 0;
+
+    if(parser->cell_layout == N1_CSV_CELL_LAYOUT_SPARSE){
+      n1_csv_sample_rows(parser);
+    }
+    return;
+  }
+
+  const uint32_t column_count = parser->column_count;
+  const uint64_t cell_count   = parser->cell_count;
+  
+  if(!first_row || parser->row_count > parser->column_stride){
+    
+    uint32_t stride = parser->row_count;
+    if(first_row && stride < parser->column_stride * 2){
+      stride = parser->column_stride * 2;
+    }
+    
+    uint32_t* column_data = (uint32_t*)n1_csv_malloc(((size_t)column_count + 1) * stride * sizeof(uint32_t));
+    
+    if(first_row){
+      for(uint32_t column = 0; column <= column_count; column++){
+        memcpy(column_data + (size_t)column * stride,
+               parser->column_data + (size_t)column * parser->column_stride,
+               first_row * sizeof(uint32_t));
+      }
+    }
+    
+    n1_csv_free(parser->column_data);
+    parser->column_data   = column_data;
+    parser->column_stride = stride;
+  }
+
+  const size_t stride = parser->column_stride;
+  
+  for(uint32_t row = first_row; row < parser->row_count; row++){
+    
+    const uint64_t     idx   = (uint64_t)(row - first_row) * column_count;
+    const n1_CSV_Cell* cells = parser->cell_data + idx;
+    uint32_t*          at    = parser->column_data + row;
+    
+    //last rows can be short, cells past them are never read
+    uint32_t cells_on_row = column_count;
+    if(idx + cells_on_row > cell_count){
+      cells_on_row = idx < cell_count ? (uint32_t)(cell_count - idx) : 0;
+    }
+    
+    uint32_t row_end = 0;
+    for(uint32_t column = 0; column < cells_on_row; column++){
+      at[column * stride] = cells[column].start;
+    }
+    if(cells_on_row){
+      row_end = cells[cells_on_row - 1].end + 1;
+    }
+    for(uint32_t column = cells_on_row; column <= column_count; column++){
+      at[column * stride] = row_end;
+    }
+  }
+
+  parser->cell_count = first_cell + cell_count;
+  
+  n1_csv_give_buffer(parser->arena, parser->cell_data, parser->max_cells * sizeof(n1_CSV_Cell));
+  parser->cell_data = NULL;
+  parser->max_cells = 0;
+}
+
+static uint32_t n1_csv_get_row_interval(n1_CSV_Parser* parser){
+
+  if(parser->cell_layout != N1_CSV_CELL_LAYOUT_SPARSE){
+    return 0;
+  }
+  //rows dropped by filters aren't counted, so rows between samples couldn't be found again
+  if(parser->filter_count || !parser->row_sampling){
+    return 1;
+  }
+  return parser->row_sampling;
+}
+
+static uint32_t n1_csv_get_row_offset_count(n1_CSV_Parser* parser){
+
+  if(parser->row_interval <= 1){
+    return parser->row_count;
+  }
+  return (parser->row_count + parser->row_interval - 1) / parser->row_interval;
+}
+
+static void n1_csv_sample_rows(n1_CSV_Parser* parser){
+
+  n1_csv_give_buffer(parser->arena, parser->cell_data, parser->max_cells * sizeof(n1_CSV_Cell));
+  parser->cell_data    = NULL;
+  parser->max_cells    = 0;
+  parser->row_interval = n1_csv_get_row_interval(parser);
+
+  if(parser->row_interval <= 1){
+    return;
+  }
+  
+  const uint32_t interval = parser->row_interval;
+  const uint32_t count    = n1_csv_get_row_offset_count(parser);
+  
+  for(uint32_t i = 1; i < count; i++){
+    parser->row_offsets[i] = parser->row_offsets[(uint64_t)i * interval];
+  }
+
+  const uint64_t max_rows = count ? count : 1;
+  
+  parser->row_offsets = (uint64_t*)n1_csv_resize_buffer(parser->row_offsets,
+                                                        parser->max_rows * sizeof(uint64_t),
+                                                        max_rows * sizeof(uint64_t));
+  parser->max_rows    = max_rows;
+}
+
+static void n1_csv_init_split_row(n1_CSV_Parser* parser, char delim_token, char quote_token, char row_token){
+
+  parser->split_row.valid       = N1_CSV_FALSE;
+  parser->split_row.delim_token = delim_token;
+  parser->split_row.quote_token = quote_token;
+  parser->split_row.row_token   = row_token;
+}
+
+static size_t n1_csv_read_file_at(n1_CSV_Parser* parser, char* buffer, uint64_t offset, size_t size){
+
+  n1_CSV_CellPage* page = &parser->cell_page;
+  size_t bytes_read     = 0;
+
+  //parsers created from a buffer or an fd have no file to open
+  if(page->file_handle == 0 && !parser->filename){
+    return 0;
+  }
+  
+#if defined(__linux__)
+  
+  if(page->file_handle == 0){
+    page->file_handle = open(parser->filename, O_RDONLY);
+  }
+  if(page->file_handle == -1){
+    perror("Failed to open file:");
+    return 0;
+  }
+
+  while(bytes_read < size){
+    ssize_t result = pread(page->file_handle, buffer + bytes_read, size - bytes_read, (off_t)(offset + bytes_read));
+    if(result <= 0){
+      break;
+    }
+    bytes_read += result;
+  }
+  
+#elif defined(_WIN32)
+
+  if(page->file_handle == 0){
+    page->file_handle = CreateFile(parser->filename,
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   NULL,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_READONLY,
+                                   NULL);
+  }
+  if(page->file_handle == INVALID_HANDLE_VALUE){
+    perror("Failed to open file:");
+    return 0;
+  }
+
+  while(bytes_read < size){
+    uint64_t   at     = offset + bytes_read;
+    DWORD      result = 0;
+    OVERLAPPED overlapped;
+    n1_memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)at;
+    overlapped.OffsetHigh = (DWORD)(at >> 32);
+    
+    if(!ReadFile(page->file_handle, buffer + bytes_read, (DWORD)(size - bytes_read), &result, &overlapped) || !result){
+      break;
+    }
+    bytes_read += result;
+  }
+  
+#endif
+
+  return bytes_read;
+}
+
+static void n1_csv_split_row(n1_CSV_Parser* parser, uint32_t row){
+
+  n1_CSV_SplitRow* split = &parser->split_row;
+  
+  if(split->valid && split->row == row){
+    return;
+  }
+
+  const uint32_t interval  = parser->row_interval;
+  uint32_t       skip_rows = row % interval;
+  uint64_t       offset    = parser->row_offsets[row / interval];
+
+  n1_CSV_TokenStream tokens;
+  tokens.token_count = 0;
+  tokens.max_tokens  = split->max_tokens;
+  tokens.tokens      = split->tokens;
+  tokens.quote_carry = 0;
+  tokens.speculative = N1_CSV_FALSE;
+  
+  if(!tokens.tokens){
+    tokens.tokens = (n1_CSV_Token*)n1_csv_reserve_buffer(NULL, NULL, &tokens.max_tokens, 64, sizeof(n1_CSV_Token));
+  }
+
+  void (*tokenize_proc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t) = n1_csv_select_tokenizer();
+
+  //start with about as many bytes as the rows up to row take on average
+  size_t chunk_size = (size_t)(parser->file_size / (parser->row_count ? parser->row_count : 1)) * (skip_rows + 1);
+  if(chunk_size < N1_CSV_SPLIT_SIZE){
+    chunk_size = N1_CSV_SPLIT_SIZE;
+  }
+  chunk_size = (chunk_size + 63) & ~(size_t)63;
+  
+  split->row_start  = offset;
+  split->data_start = offset;
+  split->cell_count = 0;
+  
+  uint64_t token_idx  = 0;
+  uint64_t end        = offset;
+  uint64_t cell_start = offset;
+  uint32_t column     = 0;
+  int8_t   done       = N1_CSV_FALSE;
+  
+  while(!done && end < parser->file_size){
+
+    size_t bytes_to_read = chunk_size;
+    if(bytes_to_read > parser->file_size - end){
+      bytes_to_read = parser->file_size - end;
+    }
+
+    if(parser->file_data){
+      n1_csv_tokenize_memory(parser, &tokens, tokenize_proc, split->delim_token, split->quote_token, split->row_token, end, bytes_to_read);
+    }else{
+      const size_t used = end - split->data_start;
+      
+      if(used + bytes_to_read > split->max_data){
+        split->max_data = (used + bytes_to_read) * 2;
+        split->data     = (char*)n1_csv_realloc(split->data, split->max_data);
+      }
+
+      //padding past the end of file is tokenized as null chars
+      char*  buffer     = split->data + used;
+      size_t bytes_read = n1_csv_read_file_at(parser, buffer, end, bytes_to_read);
+      n1_memset(buffer + bytes_read, 0, bytes_to_read - bytes_read);
+      
+      tokenize_proc(parser, &tokens, split->delim_token, split->quote_token, split->row_token, buffer, end, bytes_to_read);
+    }
+    
+    end        += bytes_to_read;
+    chunk_size <<= 1;
+    
+    for(; !done && token_idx < tokens.token_count; token_idx++){
+      
+      const n1_CSV_Token token = tokens.tokens[token_idx];
+
+      if(skip_rows){
+        if(token.type == N1_CSV_TOKEN_TYPE_ROW){
+          skip_rows --;
+          cell_start       = token.offset + 1;
+          split->row_start = cell_start;
+        }
+        done = token.type == N1_CSV_TOKEN_TYPE_NULL;
+        continue;
+      }
+      
+      const int8_t selected = !parser->column_mask || (column < parser->column_mask_size && parser->column_mask[column]);
+      
+      if(selected){
+        if(split->cell_count >= split->max_cells){
+          split->max_cells = split->max_cells ? split->max_cells * 2 : 64;
+          split->cells     = (n1_CSV_Cell*)n1_csv_realloc(split->cells, split->max_cells * sizeof(n1_CSV_Cell));
+        }
+        
+        n1_CSV_Cell cell;
+        cell.start = (uint32_t)(cell_start - split->row_start);
+        cell.end   = (uint32_t)(token.offset - split->row_start);
+        split->cells[split->cell_count++] = cell;
+      }
+      
+      column ++;
+      cell_start = token.offset + 1;
+      done       = token.type != N1_CSV_TOKEN_TYPE_DELIM;
+    }
+  }
+
+  split->tokens     = tokens.tokens;
+  split->max_tokens = tokens.max_tokens;
+  split->row        = row;
+  split->valid      = N1_CSV_TRUE;
+}
+
+static void n1_csv_init_page_cache(n1_CSV_Parser* parser){
+
+  n1_CSV_PageCache* cache = &parser->page_cache;
+
+  cache->page_count = (uint32_t)(parser->cache_size / N1_CSV_PAGE_CACHE_BLOCK_SIZE);
+  cache->pages      = (n1_CSV_CachePage*)n1_csv_malloc(cache->page_count * sizeof(n1_CSV_CachePage));
+  cache->data       = (char*)n1_csv_malloc((size_t)cache->page_count * N1_CSV_PAGE_CACHE_BLOCK_SIZE);
+
+  uint32_t bucket_count = 1;
+  while(bucket_count < cache->page_count * 2){
+    bucket_count <<= 1;
+  }
+  cache->buckets     = (int32_t*)n1_csv_malloc(bucket_count * sizeof(int32_t));
+  cache->bucket_mask = bucket_count - 1;
+  
+  for(uint32_t i = 0; i < cache->page_count; i++){
+    cache->pages[i].data = cache->data + (size_t)i * N1_CSV_PAGE_CACHE_BLOCK_SIZE;
+  }
+  
+  n1_csv_clear_page_cache(parser);
+}
+
+static void n1_csv_clear_page_cache(n1_CSV_Parser* parser){
+
+  n1_CSV_PageCache* cache = &parser->page_cache;
+
+  if(!cache->pages){
+    return;
+  }
+  
+  for(uint32_t i = 0; i < cache->page_count; i++){
+    cache->pages[i].block      = UINT64_MAX;
+    cache->pages[i].next       = -1;
+    cache->pages[i].referenced = N1_CSV_FALSE;
+  }
+  for(uint32_t i = 0; i <= cache->bucket_mask; i++){
+    cache->buckets[i] = -1;
+  }
+  
+  cache->clock_hand = 0;
+  cache->last_page  = 0;
+  cache->next_block = UINT64_MAX;
+}
+
+static void n1_csv_destroy_page_cache(n1_CSV_Parser* parser){
+
+  n1_CSV_PageCache* cache = &parser->page_cache;
+  
+  n1_csv_free(cache->pages);
+  n1_csv_free(cache->data);
+  n1_csv_free(cache->buckets);
+  n1_csv_free(cache->span);
+
+  cache->pages      = NULL;
+  cache->data       = NULL;
+  cache->buckets    = NULL;
+  cache->page_count = 0;
+  cache->span       = NULL;
+  cache->max_span   = 0;
+}
+
+static n1_CSV_CachePage* n1_csv_evict_page(n1_CSV_PageCache* cache){
+
+  n1_CSV_CachePage* page = NULL;
+  
+  for(;;){
+    page = &cache->pages[cache->clock_hand];
+    cache->clock_hand = cache->clock_hand + 1 == cache->page_count ? 0 : cache->clock_hand + 1;
+
+    if(!page->referenced){
+      break;
+    }
+    page->referenced = N1_CSV_FALSE;
+  }
+
+  if(page->block != UINT64_MAX){
+    const int32_t index = (int32_t)(page - cache->pages);
+    int32_t*      link  = &cache->buckets[page->block & cache->bucket_mask];
+    
+    while(*link != index){
+      link = &cache->pages[*link].next;
+    }
+    *link = page->next;
+  }
+  
+  //set so the hand doesn't come back to it while the rest of a read ahead is evicted
+  page->block      = UINT64_MAX;
+  page->next       = -1;
+  page->referenced = N1_CSV_TRUE;
+  return page;
+}
+
+static char* n1_csv_get_cached_block(n1_CSV_Parser* parser, uint64_t block){
+
+  const uint64_t    block_size = N1_CSV_PAGE_CACHE_BLOCK_SIZE;
+  n1_CSV_PageCache* cache      = &parser->page_cache;
+  
+  for(int32_t i = cache->buckets[block & cache->bucket_mask]; i != -1; i = cache->pages[i].next){
+    if(cache->pages[i].block == block){
+      cache->hits++;
+      cache->pages[i].referenced = N1_CSV_TRUE;
+      cache->last_page = i;
+      return cache->pages[i].data;
+    }
+  }
+
+  cache->misses++;
+
+  //sequential misses read the following blocks too, up to one that is cached already
+  uint32_t count = 1;
+  if(block == cache->next_block){
+    
+    uint32_t max_count = parser->read_ahead + 1;
+    if(max_count > cache->page_count / 2){
+      max_count = cache->page_count / 2;
+    }
+    if(max_count > 64){
+      max_count = 64;
+    }
+    
+    for(; count < max_count && (block + count) * block_size < parser->file_size; count++){
+      int8_t cached = N1_CSV_FALSE;
+      for(int32_t i = cache->buckets[(block + count) & cache->bucket_mask]; i != -1; i = cache->pages[i].next){
+        cached |= cache->pages[i].block == block + count;
+      }
+      if(cached){
+        break;
+      }
+    }
+  }
+
+  n1_CSV_CachePage* pages[64];
+  for(uint32_t i = 0; i < count; i++){
+    pages[i] = n1_csv_evict_page(cache);
+  }
+
+  size_t bytes_read = 0;
+  
+#if defined(__linux__)
+  
+  if(parser->cell_page.file_handle == 0){
+    parser->cell_page.file_handle = open(parser->filename, O_RDONLY);
+  }
+  
+  struct iovec buffers[64];
+  for(uint32_t i = 0; i < count; i++){
+    buffers[i].iov_base = pages[i]->data;
+    buffers[i].iov_len  = block_size;
+  }
+
+  //one read for every block
+  while(parser->cell_page.file_handle != -1 && bytes_read < count * block_size){
+    
+    uint32_t first  = (uint32_t)(bytes_read / block_size);
+    size_t   offset = bytes_read % block_size;
+    
+    buffers[first].iov_base = pages[first]->data + offset;
+    buffers[first].iov_len  = block_size - offset;
+    
+    ssize_t result = preadv(parser->cell_page.file_handle, buffers + first, (int)(count - first), (off_t)(block * block_size + bytes_read));
+    if(result <= 0){
+      break;
+    }
+    bytes_read += result;
+  }
+  
+#elif defined(_WIN32)
+
+  for(uint32_t i = 0; i < count; i++){
+    bytes_read += n1_csv_read_file_at(parser, pages[i]->data, (block + i) * block_size, block_size);
+    if(bytes_read < (i + 1) * block_size){
+      break;
+    }
+  }
+  
+#endif
+
+  if(!bytes_read){
+    return NULL;
+  }
+  
+  for(uint32_t i = 0; i < count; i++){
+    const size_t page_start = (size_t)i * block_size;
+    
+    //rest of the last block is padding
+    if(bytes_read < page_start + block_size){
+      if(bytes_read <= page_start){
+        break;
+      }
+      n1_memset(pages[i]->data + (bytes_read - page_start), 0, page_start + block_size - bytes_read);
+    }
+    
+    int32_t* bucket = &cache->buckets[(block + i) & cache->bucket_mask];
+    
+    pages[i]->block = block + i;
+    pages[i]->next  = *bucket;
+    *bucket         = (int32_t)(pages[i] - cache->pages);
+  }
+  
+  cache->next_block = block + count;
+  cache->last_page  = (uint32_t)(pages[0] - cache->pages);
+  
+  return pages[0]->data;
+}
+
+static char* n1_csv_read_cached(n1_CSV_Parser* parser, uint64_t start, uint64_t end){
+
+  const uint64_t block_size = N1_CSV_PAGE_CACHE_BLOCK_SIZE;
+  
+  if(parser->cache_size / block_size < 2){
+    return NULL;
+  }
+  
+  n1_CSV_PageCache* cache = &parser->page_cache;
+  
+  if(!cache->pages){
+    n1_csv_init_page_cache(parser);
+  }
+
+  const uint64_t first_block = start / block_size;
+  const uint64_t last_block  = end > start ? (end - 1) / block_size : first_block;
+  
+  if(first_block == last_block){
+
+    //cells of a row are mostly in the same block
+    n1_CSV_CachePage* page = &cache->pages[cache->last_page];
+    if(page->block == first_block){
+      cache->hits++;
+      page->referenced = N1_CSV_TRUE;
+      return page->data + (start - first_block * block_size);
+    }
+    
+    char* data = n1_csv_get_cached_block(parser, first_block);
+    return data ? data + (start - first_block * block_size) : NULL;
+  }
+  
+  if(end - start > cache->max_span){
+    cache->max_span = (size_t)(end - start) * 2;
+    cache->span     = (char*)n1_csv_realloc(cache->span, cache->max_span);
+  }
+  
+  for(uint64_t block = first_block; block <= last_block; block++){
+    
+    char* data = n1_csv_get_cached_block(parser, block);
+    if(!data){
+      return NULL;
+    }
+    
+    const uint64_t from = block == first_block ? start : block * block_size;
+    const uint64_t to   = block == last_block ? end : (block + 1) * block_size;
+    memcpy(cache->span + (from - start), data + (from - block * block_size), to - from);
+  }
+  
+  return cache->span;
+}
+
+static int8_t n1_csv_init_ring(n1_CSV_Ring* ring, uint32_t entries){
+
+  ring->fd      = -1;
+  ring->pending = 0;
+  
+#if defined(N1_CSV_HAS_IO_URING)
+
+  struct io_uring_params params;
+  n1_memset(&params, 0, sizeof(params));
+
+  int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if(fd < 0){
+    return N1_CSV_FALSE;
+  }
+
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  //both rings are in one mapping on newer kernels
+  if(params.features & IORING_FEAT_SINGLE_MMAP){
+    if(ring->cq_ring_size > ring->sq_ring_size){
+      ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->cq_ring_size = 0;
+  }
+  
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = ring->sq_ring;
+  if(ring->sq_ring != MAP_FAILED && ring->cq_ring_size){
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqes = (struct io_uring_sqe*)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+  if(ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || (void*)ring->sqes == MAP_FAILED){
+    if(ring->sq_ring != MAP_FAILED){
+      munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if(ring->cq_ring_size && ring->cq_ring != MAP_FAILED){
+      munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if((void*)ring->sqes != MAP_FAILED){
+      munmap(ring->sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+    }
+    close(fd);
+    return N1_CSV_FALSE;
+  }
+
+  char* sq = (char*)ring->sq_ring;
+  char* cq = (char*)ring->cq_ring;
+  
+  ring->sq_head  = (uint32_t*)(sq + params.sq_off.head);
+  ring->sq_tail  = (uint32_t*)(sq + params.sq_off.tail);
+  ring->sq_mask  = (uint32_t*)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+  ring->cq_head  = (uint32_t*)(cq + params.cq_off.head);
+  ring->cq_tail  = (uint32_t*)(cq + params.cq_off.tail);
+  ring->cq_mask  = (uint32_t*)(cq + params.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  
+  ring->fd      = fd;
+  ring->entries = params.sq_entries;
+  return N1_CSV_TRUE;
+
+#else
+  (void)entries;
+  return N1_CSV_FALSE;
+#endif
+}
+
+static void n1_csv_destroy_ring(n1_CSV_Ring* ring){
+
+#if defined(N1_CSV_HAS_IO_URING)
+  if(ring->fd == -1){
+    return;
+  }
+  
+  munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+  munmap(ring->sq_ring, ring->sq_ring_size);
+  if(ring->cq_ring_size){
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  close(ring->fd);
+#endif
+
+  ring->fd = -1;
+}
+
+static void n1_csv_ring_read(n1_CSV_Ring* ring, int file, char* buffer, uint32_t size, uint64_t offset, uint64_t user_data, int32_t buffer_index){
+
+#if defined(N1_CSV_HAS_IO_URING)
+  //only this thread writes the tail
+  const uint32_t tail  = *ring->sq_tail;
+  const uint32_t index = tail & *ring->sq_mask;
+  
+  struct io_uring_sqe* sqe = &ring->sqes[index];
+  n1_memset(sqe, 0, sizeof(*sqe));
+  
+  sqe->opcode    = buffer_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd        = file;
+  sqe->addr      = (uint64_t)(uintptr_t)buffer;
+  sqe->len       = size;
+  sqe->off       = offset;
+  sqe->buf_index = (uint16_t)(buffer_index >= 0 ? buffer_index : 0);
+  sqe->user_data = user_data;
+
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending++;
+#else
+  (void)ring; (void)file; (void)buffer; (void)size; (void)offset; (void)user_data; (void)buffer_index;
+#endif
+}
+
+static int8_t n1_csv_ring_submit(n1_CSV_Ring* ring, uint32_t wait_count){
+
+#if defined(N1_CSV_HAS_IO_URING)
+  for(;;){
+    long result = syscall(__NR_io_uring_enter, ring->fd, ring->pending, wait_count, wait_count ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if(result >= 0){
+      ring->pending -= (uint32_t)result;
+      return N1_CSV_TRUE;
+    }
+    if(errno != EINTR){
+      perror("Failed to submit reads:");
+      n1_csv_destroy_ring(ring);
+      return N1_CSV_FALSE;
+    }
+  }
+#else
+  (void)ring; (void)wait_count;
+  return N1_CSV_FALSE;
+#endif
+}
+
+static int8_t n1_csv_ring_complete(n1_CSV_Ring* ring, uint64_t* user_data, int64_t* result){
+
+#if defined(N1_CSV_HAS_IO_URING)
+  if(ring->fd == -1){
+    return N1_CSV_FALSE;
+  }
+  
+  const uint32_t head = *ring->cq_head;
+  if(head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+    return N1_CSV_FALSE;
+  }
+
+  const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+  *user_data = cqe->user_data;
+  *result    = cqe->res;
+
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return N1_CSV_TRUE;
+#else
+  (void)ring; (void)user_data; (void)result;
+  return N1_CSV_FALSE;
+#endif
+}
+
+static n1_CSV_Reader* n1_csv_acquire_reader(n1_CSV_Parser* parser){
+
+  for(uint32_t i = 0; i < N1_CSV_MAX_READERS; i++){
+    if(n1_csv_atomic_load(&parser->reader_busy[i]) || !n1_csv_atomic_compare_exchange(&parser->reader_busy[i], 0, 1)){
+      continue;
+    }
+
+    if(!parser->readers[i]){
+      parser->readers[i] = n1_csv_create_reader(parser);
+      if(!parser->readers[i]){
+        n1_csv_atomic_store(&parser->reader_busy[i], 0);
+        return NULL;
+      }
+      parser->readers[i]->index = i;
+    }
+
+    //the file may have grown since the reader was created
+    parser->readers[i]->file_size = parser->file_size;
+    return parser->readers[i];
+  }
+  
+  return NULL;
+}
+
+static void n1_csv_release_reader(n1_CSV_Parser* parser, n1_CSV_Reader* reader){
+
+  //reads of a section that wasn't read to the end still write into the buffers
+  while(reader->outstanding){
+    uint64_t user_data;
+    int64_t  result;
+    
+    n1_csv_submit_blocks(reader, 1);
+    while(n1_csv_ring_complete(&reader->ring, &user_data, &result)){
+      reader->outstanding--;
+    }
+  }
+  
+  n1_csv_atomic_store(&parser->reader_busy[reader->index], 0);
+}
+
+static n1_CSV_Reader* n1_csv_create_reader(n1_CSV_Parser* parser){
+
+  n1_CSV_Reader* reader = (n1_CSV_Reader*)n1_csv_malloc(sizeof(n1_CSV_Reader));
+  n1_memset(reader, 0, sizeof(*reader));
+
+  const size_t page_size = n1_csv_get_page_size();
+  
+  reader->block_size = (parser->read_block_size + page_size - 1) / page_size * page_size;
+  reader->ring.fd    = -1;
+  reader->depth      = 1;
+  
+#if defined(__linux__)
+
+  //O_DIRECT isn't allowed by every file system
+  reader->file = -1;
+#if defined(O_DIRECT)
+  if(parser->io_direct){
+    reader->file   = open(parser->filename, O_RDONLY | O_DIRECT);
+    reader->direct = reader->file != -1;
+  }
+#endif
+  if(reader->file == -1){
+    reader->file = open(parser->filename, O_RDONLY);
+  }
+  if(reader->file == -1){
+    perror("Failed to reopen file:");
+    n1_csv_free(reader);
+    return NULL;
+  }
+
+  if(parser->io == N1_CSV_IO_URING && parser->file_size >= N1_CSV_URING_MIN_FILE_SIZE && n1_csv_init_ring(&reader->ring, parser->queue_depth)){
+    reader->depth = parser->queue_depth;
+  }
+  
+  //page aligned for O_DIRECT
+  reader->buffers = (char*)mmap(NULL, reader->depth * reader->block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(reader->buffers == MAP_FAILED){
+    n1_csv_destroy_ring(&reader->ring);
+    close(reader->file);
+    n1_csv_free(reader);
+    return NULL;
+  }
+
+#if defined(N1_CSV_HAS_IO_URING)
+  //registered buffers stay mapped in the kernel, reads into them skip pinning pages every time
+  if(reader->ring.fd != -1){
+    struct iovec buffers[N1_CSV_MAX_READ_QUEUE_DEPTH];
+    for(uint32_t i = 0; i < reader->depth; i++){
+      buffers[i].iov_base = reader->buffers + i * reader->block_size;
+      buffers[i].iov_len  = reader->block_size;
+    }
+    reader->registered = syscall(__NR_io_uring_register, reader->ring.fd, IORING_REGISTER_BUFFERS, buffers, reader->depth) == 0;
+  }
+#endif
+  
+#elif defined(_WIN32)
+
+  reader->file = CreateFile(parser->filename,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_READONLY,
+                            NULL);
+  if(reader->file == INVALID_HANDLE_VALUE){
+    perror("Failed to reopen file:");
+    n1_csv_free(reader);
+    return NULL;
+  }
+  
+  reader->buffers = (char*)n1_csv_malloc(reader->block_size);
+  
+#endif
+
+  return reader;
+}
+
+static void n1_csv_destroy_readers(n1_CSV_Parser* parser){
+
+  for(uint32_t i = 0; i < N1_CSV_MAX_READERS; i++){
+    n1_CSV_Reader* reader = parser->readers[i];
+    if(!reader){
+      continue;
+    }
+    
+    n1_csv_destroy_ring(&reader->ring);
+    
+#if defined(__linux__)
+    munmap(reader->buffers, reader->depth * reader->block_size);
+    close(reader->file);
+#elif defined(_WIN32)
+    n1_csv_free(reader->buffers);
+    CloseHandle(reader->file);
+#endif
+
+    n1_csv_free(reader);
+    parser->readers[i] = NULL;
+  }
+}
+
+static size_t n1_csv_reader_read_at(n1_CSV_Reader* reader, char* buffer, uint64_t offset, size_t size){
+
+  size_t bytes_read = 0;
+  
+#if defined(__linux__)
+  
+  while(bytes_read < size){
+    ssize_t result = pread(reader->file, buffer + bytes_read, size - bytes_read, (off_t)(offset + bytes_read));
+    if(result <= 0){
+      break;
+    }
+    bytes_read += result;
+  }
+  
+#elif defined(_WIN32)
+
+  while(bytes_read < size){
+    OVERLAPPED overlapped;
+    n1_memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)(offset + bytes_read);
+    overlapped.OffsetHigh = (DWORD)((offset + bytes_read) >> 32);
+
+    DWORD result = 0;
+    if(!ReadFile(reader->file, buffer + bytes_read, (DWORD)(size - bytes_read), &result, &overlapped) || !result){
+      break;
+    }
+    bytes_read += result;
+  }
+  
+#endif
+
+  return bytes_read;
+}
+
+static void n1_csv_start_reader(n1_CSV_Reader* reader, uint64_t start, uint64_t end){
+
+  //O_DIRECT reads whole pages
+  const uint64_t alignment = reader->direct ? n1_csv_get_page_size() : 1;
+  
+  reader->start       = start;
+  reader->end         = end;
+  reader->read_end    = (end + alignment - 1) / alignment * alignment;
+  reader->next_offset = start / alignment * alignment;
+  reader->head        = 0;
+  reader->queued      = 0;
+  reader->returned    = -1;
+
+  for(uint32_t i = 0; i < reader->depth && reader->next_offset < end; i++){
+    n1_csv_queue_block(reader, i);
+  }
+  
+  if(reader->ring.fd != -1){
+    n1_csv_submit_blocks(reader, 0);
+  }
+}
+
+static void n1_csv_queue_block(n1_CSV_Reader* reader, uint32_t buffer){
+
+  reader->offsets[buffer] = reader->next_offset;
+  reader->sizes[buffer]   = reader->read_end - reader->next_offset < reader->block_size ? (size_t)(reader->read_end - reader->next_offset) : reader->block_size;
+  reader->results[buffer] = N1_CSV_READ_IN_FLIGHT;
+  reader->next_offset    += reader->sizes[buffer];
+  reader->queued++;
+
+  //without a ring the block is read when it's needed
+#if defined(N1_CSV_HAS_IO_URING)
+  if(reader->ring.fd != -1){
+    n1_csv_ring_read(&reader->ring,
+                     reader->file,
+                     reader->buffers + buffer * reader->block_size,
+                     (uint32_t)reader->sizes[buffer],
+                     reader->offsets[buffer],
+                     buffer,
+                     reader->registered ? (int32_t)buffer : -1);
+    reader->outstanding++;
+  }
+#endif
+}
+
+static void n1_csv_submit_blocks(n1_CSV_Reader* reader, uint32_t wait_count){
+
+  if(n1_csv_ring_submit(&reader->ring, wait_count)){
+    return;
+  }
+  
+  for(uint32_t i = 0; i < reader->depth; i++){
+    if(reader->results[i] == N1_CSV_READ_IN_FLIGHT){
+      reader->results[i] = -EIO;
+    }
+  }
+  reader->outstanding = 0;
+}
+
+static char* n1_csv_next_block(n1_CSV_Reader* reader, uint64_t* offset, size_t* size){
+
+  //the caller is done with the block returned last, read ahead into its buffer
+  if(reader->returned != -1 && reader->next_offset < reader->end){
+    n1_csv_queue_block(reader, (uint32_t)reader->returned);
+  }
+  reader->returned = -1;
+  
+  if(!reader->queued){
+    return NULL;
+  }
+
+  const uint32_t buffer = reader->head;
+  char*          data   = reader->buffers + buffer * reader->block_size;
+  
+  reader->head = reader->head + 1 == reader->depth ? 0 : reader->head + 1;
+  reader->queued--;
+
+  if(reader->ring.fd != -1){
+    n1_csv_submit_blocks(reader, 0);
+    
+    //reads can complete out of order
+    while(reader->results[buffer] == N1_CSV_READ_IN_FLIGHT){
+      uint64_t user_data;
+      int64_t  result;
+      
+      if(!n1_csv_ring_complete(&reader->ring, &user_data, &result)){
+        n1_csv_submit_blocks(reader, 1);
+        continue;
+      }
+      reader->results[user_data] = result;
+      reader->outstanding--;
+    }
+  }else{
+    reader->results[buffer] = (int64_t)n1_csv_reader_read_at(reader, data, reader->offsets[buffer], reader->sizes[buffer]);
+
+#if defined(__linux__)
+    //the OS reads the next block in the background while this one is tokenized. O_DIRECT reads skip the page cache.
+    if(!reader->direct && reader->next_offset < reader->read_end){
+      const uint64_t next_size = reader->read_end - reader->next_offset < reader->block_size ? reader->read_end - reader->next_offset : reader->block_size;
+      posix_fadvise(reader->file, (off_t)reader->next_offset, (off_t)next_size, POSIX_FADV_WILLNEED);
+    }
+#endif
+  }
+
+  const size_t read_size = reader->sizes[buffer];
+  
+  //failed reads are done again without the ring, short ones are finished unless they reached the end of the file
+  size_t bytes_read = reader->results[buffer] > 0 ? (size_t)reader->results[buffer] : 0;
+  if(bytes_read < read_size && (reader->results[buffer] < 0 || reader->offsets[buffer] + bytes_read < reader->file_size)){
+    bytes_read += n1_csv_reader_read_at(reader, data + bytes_read, reader->offsets[buffer] + bytes_read, read_size - bytes_read);
+  }
+  
+  //padding past the end of file is tokenized as null chars
+  if(bytes_read < read_size){
+    n1_memset(data + bytes_read, 0, read_size - bytes_read);
+  }
+
+  uint64_t block_start = reader->offsets[buffer];
+  uint64_t block_end   = block_start + read_size;
+  
+  if(block_start < reader->start){
+    data       += reader->start - block_start;
+    block_start = reader->start;
+  }
+  if(block_end > reader->end){
+    block_end = reader->end;
+  }
+
+  reader->returned = (int32_t)buffer;
+  
+  *offset = block_start;
+  *size   = block_end - block_start;
+  return data;
+}
+
+static int8_t n1_csv_locate_cell(n1_CSV_Parser* parser, uint32_t column, uint32_t row, uint64_t* start, uint32_t* length){
+
+  if(row >= parser->row_count || column >= parser->column_count || (uint64_t)parser->column_count * row + column >= parser->cell_count){
+    return N1_CSV_FALSE;
+  }
+
+  if(parser->row_interval){
+    n1_csv_split_row(parser, row);
+    
+    const n1_CSV_SplitRow* split = &parser->split_row;
+    
+    //short rows have fewer cells
+    if(column >= split->cell_count){
+      return N1_CSV_FALSE;
+    }
+    *start  = split->row_start + split->cells[column].start;
+    *length = split->cells[column].end - split->cells[column].start;
+    return N1_CSV_TRUE;
+  }
+  
+  n1_CSV_Cell cell;
+  if(parser->column_data){
+    const uint32_t* starts = parser->column_data + (size_t)column * parser->column_stride;
+    cell.start = starts[row];
+    cell.end   = starts[parser->column_stride + row] - 1;
+  }else{
+    cell = parser->cell_data[(uint64_t)parser->column_count * row + column];
+  }
+  
+  *start  = parser->row_offsets[row] + cell.start;
+  *length = cell.end - cell.start;
+  return N1_CSV_TRUE;
+}
+
+static int n1_csv_compare_batch_cells(const void* a, const void* b){
+
+  const uint64_t key_a = ((const n1_CSV_BatchCell*)a)->key;
+  const uint64_t key_b = ((const n1_CSV_BatchCell*)b)->key;
+  
+  return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static void n1_csv_reserve_batch(n1_CSV_Parser* parser, uint64_t count){
+
+  n1_CSV_Batch* batch = &parser->batch;
+  
+  if(count > batch->max_cells){
+    batch->max_cells = count;
+    batch->cells     = (n1_CSV_BatchCell*)n1_csv_realloc(batch->cells, count * sizeof(n1_CSV_BatchCell));
+  }
+}
+
+static void n1_csv_read_ranges(n1_CSV_Parser* parser, uint64_t range_count){
+
+  n1_CSV_Batch*  batch  = &parser->batch;
+  n1_CSV_Reader* reader = range_count > 1 ? n1_csv_acquire_reader(parser) : NULL;
+
+  //reads of O_DIRECT readers would have to be aligned
+  if(!reader || reader->ring.fd == -1 || reader->direct){
+    for(uint64_t i = 0; i < range_count; i++){
+      n1_CSV_BatchRange* range = &batch->ranges[i];
+      range->bytes_read = n1_csv_read_file_at(parser, batch->data + range->data_offset, range->start, range->size);
+    }
+    if(reader){
+      n1_csv_release_reader(parser, reader);
+    }
+    return;
+  }
+
+#if defined(N1_CSV_HAS_IO_URING)
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  
+  while(completed < range_count){
+    for(; submitted < range_count && submitted - completed < reader->ring.entries; submitted++){
+      const n1_CSV_BatchRange* range = &batch->ranges[submitted];
+      
+      //the ring reads at most 4 GiB at a time, longer ranges are finished below
+      n1_csv_ring_read(&reader->ring,
+                       reader->file,
+                       batch->data + range->data_offset,
+                       range->size < UINT32_MAX ? (uint32_t)range->size : UINT32_MAX,
+                       range->start,
+                       submitted,
+                       -1);
+    }
+    //ranges are all read again without the ring if it fails
+    if(!n1_csv_ring_submit(&reader->ring, 1)){
+      for(uint64_t i = 0; i < range_count; i++){
+        n1_CSV_BatchRange* range = &batch->ranges[i];
+        range->bytes_read = n1_csv_reader_read_at(reader, batch->data + range->data_offset, range->start, range->size);
+      }
+      break;
+    }
+
+    uint64_t user_data;
+    int64_t  result;
+    while(n1_csv_ring_complete(&reader->ring, &user_data, &result)){
+      n1_CSV_BatchRange* range = &batch->ranges[user_data];
+      
+      range->bytes_read = result > 0 ? (size_t)result : 0;
+      if(range->bytes_read < range->size){
+        range->bytes_read += n1_csv_reader_read_at(reader,
+                                                   batch->data + range->data_offset + range->bytes_read,
+                                                   range->start + range->bytes_read,
+                                                   range->size - range->bytes_read);
+      }
+      completed++;
+    }
+  }
+#endif
+  
+  n1_csv_release_reader(parser, reader);
+}
+
+static uint64_t n1_csv_fetch_batch(n1_CSV_Parser* parser, uint64_t count, n1_CSV_String* cells, int8_t sorted){
+
+  n1_CSV_Batch*     batch   = &parser->batch;
+  n1_CSV_BatchCell* entries = batch->cells;
+
+  //rows are in file order and so are the cells of a row, which also keeps sparse rows from being split twice
+  int8_t in_order = N1_CSV_TRUE;
+  for(uint64_t i = 1; i < count && in_order && !sorted; i++){
+    in_order = entries[i - 1].key <= entries[i].key;
+  }
+  if(!in_order){
+    qsort(entries, count, sizeof(n1_CSV_BatchCell), n1_csv_compare_batch_cells);
+  }
+
+  //cells less than a block apart are read together, one read per range
+  const uint64_t max_gap = N1_CSV_PAGE_CACHE_BLOCK_SIZE;
+
+  uint64_t found       = 0;
+  uint64_t range_count = 0;
+  size_t   data_size   = 0;
+  uint64_t range_start = 0;
+  uint64_t range_end   = 0;
+  int8_t   in_range    = N1_CSV_FALSE;
+  
+  for(uint64_t i = 0; i <= count; i++){
+    n1_CSV_BatchCell* entry = i < count ? &entries[i] : NULL;
+    uint64_t          start = 0;
+    
+    if(entry){
+      const uint32_t row = (uint32_t)(entry->key >> 32);
+      
+      if(entry->key >> 32 >= parser->row_count || !n1_csv_locate_cell(parser, (uint32_t)entry->key, row, &start, &entry->length)){
+        entry->length = UINT32_MAX;
+        continue;
+      }
+      found++;
+      
+      if(in_range && start <= range_end + max_gap){
+        const uint64_t end = start + entry->length;
+        
+        range_end     = end > range_end ? end : range_end;
+        entry->offset = data_size + (start - range_start);
+        continue;
+      }
+    }
+
+    if(in_range){
+      const size_t range_size = range_end - range_start;
+      
+      if(data_size + range_size >= batch->max_data){
+        batch->max_data = (data_size + range_size) * 2 + 1;
+        batch->data     = (char*)n1_csv_realloc(batch->data, batch->max_data);
+      }
+      if(range_count == batch->max_ranges){
+        batch->max_ranges = batch->max_ranges ? batch->max_ranges * 2 : 64;
+        batch->ranges     = (n1_CSV_BatchRange*)n1_csv_realloc(batch->ranges, batch->max_ranges * sizeof(n1_CSV_BatchRange));
+      }
+      
+      batch->ranges[range_count].start       = range_start;
+      batch->ranges[range_count].size        = range_size;
+      batch->ranges[range_count].data_offset = data_size;
+      range_count++;
+      
+      data_size += range_size;
+    }
+    
+    if(entry){
+      range_start   = start;
+      range_end     = start + entry->length;
+      in_range      = N1_CSV_TRUE;
+      entry->offset = data_size;
+    }
+  }
+  
+  n1_csv_read_ranges(parser, range_count);
+
+  //entries are in file order, and so are their ranges
+  uint64_t range = 0;
+  
+  for(uint64_t i = 0; i < count; i++){
+    const n1_CSV_BatchCell* entry  = &entries[i];
+    n1_CSV_String*          string = &cells[entry->index];
+
+    string->data   = NULL;
+    string->length = 0;
+    
+    if(entry->length == UINT32_MAX){
+      continue;
+    }
+    
+    while(range + 1 < range_count && entry->offset >= batch->ranges[range + 1].data_offset){
+      range++;
+    }
+    
+    //cells of a range that couldn't be read aren't found
+    if(entry->offset + entry->length > batch->ranges[range].data_offset + batch->ranges[range].bytes_read){
+      found--;
+      continue;
+    }
+    string->data   = batch->data + entry->offset;
+    string->length = entry->length;
+  }
+  
+  return found;
+}
+
+static void n1_csv_push_cell(n1_CSV_Parser* parser, uint64_t start, uint64_t end){
+
+  if(parser->cell_layout == N1_CSV_CELL_LAYOUT_SPARSE){
+    parser->cell_count++;
+    return;
+  }
+
+  const uint64_t row_offset = parser->row_offsets[parser->row_count - 1];
+
+  n1_CSV_Cell cell;
+  cell.start = (uint32_t)(start - row_offset);
+  cell.end   = (uint32_t)(end - row_offset);
+  
+  parser->cell_data[parser->cell_count++] = cell;
+  n1_csv_maybe_realloc_cell_data(parser);
+}
+
+static void n1_csv_push_row(n1_CSV_Parser* parser, uint64_t offset){
+
+  parser->row_offsets[parser->row_count++] = offset;
+  parser->row_column     = 0;
+  parser->row_rejected   = N1_CSV_FALSE;
+  parser->row_first_cell = parser->cell_count;
+  n1_csv_maybe_realloc_row_offsets(parser);
+}
+
+static n1_CSV_Filter* n1_csv_push_filter(n1_CSV_Parser* parser, N1_CSV_FILTER type, uint32_t column, uint32_t value_count, size_t values_size){
+
+  n1_CSV_Filter* filter = (n1_CSV_Filter*)n1_csv_malloc(sizeof(n1_CSV_Filter) + value_count * sizeof(n1_CSV_String) + values_size);
+  filter->type        = type;
+  filter->column      = column;
+  filter->min         = 0;
+  filter->max         = 0;
+  filter->values      = (n1_CSV_String*)(filter + 1);
+  filter->value_count = value_count;
+  
+  parser->filters = (n1_CSV_Filter**)n1_csv_realloc(parser->filters, (parser->filter_count + 1) * sizeof(n1_CSV_Filter*));
+  parser->filters[parser->filter_count++] = filter;
+  
+  return filter;
+}
+
+static int8_t n1_csv_prepare_filters(n1_CSV_Parser* parser, char quote_token){
+
+  parser->filter_quote_token = quote_token;
+
+  if(!parser->filter_count){
+    return N1_CSV_TRUE;
+  }
+
+  if(parser->file_data){
+    parser->filter_data      = parser->file_data;
+    parser->filter_data_size = parser->data_size;
+    return N1_CSV_TRUE;
+  }
+
+  //file_data stays NULL so tokenizing still goes through the readers and the page cache.
+  //Filters never read past the end of the file, so the mapping doesn't need the zero padding.
+  if(parser->filename){
+#if defined(__linux__)
+    int file = open(parser->filename, O_RDONLY);
+    struct stat file_stat;
+    
+    if(file != -1 && !fstat(file, &file_stat) && file_stat.st_size){
+      void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+      if(data != MAP_FAILED){
+        madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+        parser->filter_data        = (char*)data;
+        parser->filter_data_size   = file_stat.st_size;
+        parser->filter_mapped_size = file_stat.st_size;
+      }
+    }
+    if(file != -1){
+      close(file);
+    }
+#elif defined(_WIN32)
+    HANDLE file = CreateFile(parser->filename,
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_READONLY | FILE_FLAG_SEQUENTIAL_SCAN,
+                             NULL);
+    LARGE_INTEGER file_size;
+    
+    if(file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &file_size) && file_size.QuadPart){
+      HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      char* data = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+      
+      if(data){
+        parser->filter_mapping     = mapping;
+        parser->filter_data        = data;
+        parser->filter_data_size   = (size_t)file_size.QuadPart;
+        parser->filter_mapped_size = (size_t)file_size.QuadPart;
+      }else if(mapping){
+        CloseHandle(mapping);
+      }
+    }
+    if(file != INVALID_HANDLE_VALUE){
+      CloseHandle(file);
+    }
+#endif
+  }
+
+  if(parser->filter_data){
+    return N1_CSV_TRUE;
+  }
+
+  perror("Failed to map file for filters:");
+  parser->row_count    = 0;
+  parser->column_count = 0;
+  parser->cell_count   = 0;
+  return N1_CSV_FALSE;
+}
+
+static void n1_csv_release_filters(n1_CSV_Parser* parser){
+
+  if(parser->filter_mapped_size){
+#if defined(__linux__)
+    munmap(parser->filter_data, parser->filter_mapped_size);
+#elif defined(_WIN32)
+    UnmapViewOfFile(parser->filter_data);
+    CloseHandle(parser->filter_mapping);
+#endif
+  }
+
+  parser->filter_data        = NULL;
+  parser->filter_data_size   = 0;
+  parser->filter_mapped_size = 0;
+}
+
+static int8_t n1_csv_unescaped_equal(n1_CSV_String cell, n1_CSV_String value, char quote_token, int8_t prefix){
+
+  uint32_t i = 0;
+  
+  for(uint32_t x = 0; x < value.length; x++, i++){
+    if(i >= cell.length || cell.data[i] != value.data[x]){
+      return N1_CSV_FALSE;
+    }
+    //second quote of a pair is skipped
+    if(cell.data[i] == quote_token && i + 1 < cell.length && cell.data[i + 1] == quote_token){
+      i++;
+    }
+  }
+  return prefix || i == cell.length;
+}
+
+static int8_t n1_csv_bytes_equal(const char* a, const char* b, uint32_t length){
+
+  uint32_t i = 0;
+  
+  for(; i + 16 <= length; i += 16){
+    const __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    const __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF){
+      return N1_CSV_FALSE;
+    }
+  }
+
+  //rest is shorter than a vector, loading it whole could read past the end of file
+  for(; i < length; i++){
+    if(a[i] != b[i]){
+      return N1_CSV_FALSE;
+    }
+  }
+  return N1_CSV_TRUE;
+}
+
+static int8_t n1_csv_check_filters(n1_CSV_Parser* parser, uint64_t start, uint64_t end){
+
+  //parses with filters don't start without the file's bytes
+  if(!parser->filter_data || start > parser->filter_data_size){
+    return N1_CSV_FALSE;
+  }
+  
+  n1_CSV_String cell;
+  cell.data   = parser->filter_data + start;
+  cell.length = (uint32_t)((end < parser->filter_data_size ? end : parser->filter_data_size) - start);
+  n1_csv_trim_cell(&cell, parser->filter_quote_token);
+
+  //only quoted cells with quotes inside them have to be unescaped
+  const int8_t escaped = cell.data != parser->filter_data + start && memchr(cell.data, parser->filter_quote_token, cell.length);
+  
+  for(uint32_t i = 0; i < parser->filter_count; i++){
+    
+    const n1_CSV_Filter* filter = parser->filters[i];
+    
+    if(filter->column != parser->row_column){
+      continue;
+    }
+
+    int8_t passed = N1_CSV_FALSE;
+    
+    switch(filter->type){
+    case N1_CSV_FILTER_EQUAL:
+    case N1_CSV_FILTER_IN:{
+      for(uint32_t x = 0; !passed && x < filter->value_count; x++){
+        if(escaped){
+          passed = n1_csv_unescaped_equal(cell, filter->values[x], parser->filter_quote_token, N1_CSV_FALSE);
+        }else{
+          passed = cell.length == filter->values[x].length && n1_csv_bytes_equal(cell.data, filter->values[x].data, cell.length);
+        }
+      }
+    }break;
+    case N1_CSV_FILTER_PREFIX:{
+      if(escaped){
+        passed = n1_csv_unescaped_equal(cell, filter->values[0], parser->filter_quote_token, N1_CSV_TRUE);
+      }else{
+        passed = cell.length >= filter->values[0].length && n1_csv_bytes_equal(cell.data, filter->values[0].data, filter->values[0].length);
+      }
+    }break;
+    case N1_CSV_FILTER_RANGE:{
+      double value;
+      passed = n1_csv_convert_double(cell.data, cell.length, &value) && value >= filter->min && value <= filter->max;
+    }break;
+    }
+    
+    if(!passed){
+      return N1_CSV_FALSE;
+    }
+  }
+  return N1_CSV_TRUE;
+}
+
+static void n1_csv_end_row(n1_CSV_Parser* parser){
+  
+  if(parser->row_rejected){
+    parser->cell_count = parser->row_first_cell;
+    parser->row_count --;
+  }
+}
+
+static int n1_csv_match_header(void* user_data, uint64_t row, n1_CSV_String* cells, uint32_t cell_count){
+
+  n1_CSV_HeaderMatch* match  = (n1_CSV_HeaderMatch*)user_data;
+  n1_CSV_Parser*      parser = match->parser;
+
+  parser->column_mask      = (uint8_t*)n1_csv_malloc(cell_count ? cell_count : 1);
+  parser->column_mask_size = cell_count;
+  
+  for(uint32_t i = 0; i < cell_count; i++){
+    n1_CSV_String cell = cells[i];
+    n1_csv_trim_cell(&cell, match->quote_token);
+
+    parser->column_mask[i] = N1_CSV_FALSE;
+    for(uint32_t x = 0; x < parser->column_name_count; x++){
+      if(strlen(parser->column_names[x]) == cell.length && !memcmp(parser->column_names[x], cell.data, cell.length)){
+        parser->column_mask[i] = N1_CSV_TRUE;
+      }
+    }
+  }
+
+  //only the first row is needed
+  return 0;
+}
+
+static void n1_csv_resolve_column_names(n1_CSV_Parser* parser,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token){
+  if(!parser->column_names){
+    return;
+  }
+
+  n1_csv_free(parser->column_mask);
+  parser->column_mask      = NULL;
+  parser->column_mask_size = 0;
+  
+  n1_CSV_HeaderMatch match;
+  match.parser      = parser;
+  match.quote_token = quote_token;
+  
+  n1_csv_parse_stream(parser, delim_token, quote_token, row_token, n1_csv_match_header, &match);
+
+  //empty file, nothing is selected
+  if(!parser->column_mask){
+    parser->column_mask = (uint8_t*)n1_csv_malloc(1);
+  }
+}
+
+static void n1_csv_maybe_realloc_token_stream(n1_CSV_TokenStream* tokens){
+  
+  if(tokens->token_count >= tokens->max_tokens){
+    tokens->tokens = (n1_CSV_Token*)n1_csv_reserve_buffer(NULL,
+                                                          tokens->tokens,
+                                                          &tokens->max_tokens,
+                                                          tokens->token_count + 1,
+                                                          sizeof(n1_CSV_Token));
+
+    if(tokens->tokens == NULL){ //failed to realloc
+      perror("realloc token stream: ");
+    }    
+  }
+}
+
+static void n1_csv_reserve_token_stream(n1_CSV_TokenStream* tokens, uint64_t count){
+  
+  if(tokens->token_count + count > tokens->max_tokens){
+    tokens->tokens = (n1_CSV_Token*)n1_csv_reserve_buffer(NULL,
+                                                          tokens->tokens,
+                                                          &tokens->max_tokens,
+                                                          tokens->token_count + count,
+                                                          sizeof(n1_CSV_Token));
+
+    if(tokens->tokens == NULL){ //failed to realloc
+      perror("realloc token stream: ");
+    }    
+  }
+}
+
+static uint32_t n1_csv_count_trailing_zeros(uint64_t value){
+  
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctzll(value);
+#endif
+}
+
+static uint64_t n1_csv_prefix_xor(uint64_t bits){
+
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+N1_CSV_TARGET("pclmul")
+static uint64_t n1_csv_prefix_xor_clmul(uint64_t bits){
+
+  //carry-less multiply by all ones
+  return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t)bits),
+                                                          _mm_set1_epi8((char)0xFF),
+                                                          0));
+}
+
+static void n1_csv_emit_block(n1_CSV_TokenStream* tokens,
+                              uint64_t delim_mask,
+                              uint64_t quote_prefix,
+                              uint64_t row_mask,
+                              uint64_t null_mask,
+                              uint64_t offset){
+
+  const uint64_t quoted_mask    = quote_prefix ^ tokens->quote_carry;
+  const uint64_t separator_mask = delim_mask | row_mask;
+
+  tokens->quote_carry = (uint64_t)((int64_t)quoted_mask >> 63);
+  
+  uint64_t token_mask = (separator_mask & ~quoted_mask) | null_mask;
+  
+  if(tokens->speculative){
+    token_mask |= separator_mask & quoted_mask;
+  }
+
+  if(null_mask){ //nothing after the first null char is tokenized
+    token_mask &= null_mask ^ (null_mask - 1);
+  }
+  
+  n1_CSV_Token* at = tokens->tokens + tokens->token_count;
+  
+  for(; token_mask; token_mask &= token_mask - 1){
+    const uint32_t i = n1_csv_count_trailing_zeros(token_mask);
+
+    n1_CSV_Token token;
+    token.type   = (N1_CSV_TOKEN_TYPE_DELIM +
+                    ((row_mask    >> i) & 1) * (N1_CSV_TOKEN_TYPE_ROW  - N1_CSV_TOKEN_TYPE_DELIM) +
+                    ((null_mask   >> i) & 1) * (N1_CSV_TOKEN_TYPE_NULL - N1_CSV_TOKEN_TYPE_DELIM) +
+                    ((quoted_mask >> i) & ~(null_mask >> i) & 1) * N1_CSV_TOKEN_TYPE_QUOTED);
+    token.offset = offset + i;
+    
+    *at++ = token;
+  }
+  
+  tokens->token_count = at - tokens->tokens;
+}
+
+static size_t n1_csv_get_page_size(){
+
+  static size_t page_size;
+
+  if(!page_size){
+#if defined(__linux__)
+
+    page_size = sysconf(_SC_PAGESIZE);
+
+#elif defined(_WIN32)
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    page_size = system_info.dwPageSize;
+
+#endif
+  }
+
+  return page_size;
+}
+static uint32_t n1_csv_get_processor_count(){
+  static uint32_t processor_count;
+
+  if(!processor_count){
+
+#if defined(__linux__)
+    processor_count = get_nprocs();    
+#elif defined(_WIN32)
+    processor_count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#endif
+  }
+  return processor_count;
+}
+static void n1_csv_stat_file(n1_CSV_Parser* parser){
+
+  parser->file_size = 0;
+  
+#if defined(__linux__)
+
+  struct stat file_stat;
+
+  if(!stat(parser->filename, &file_stat)){
+    parser->file_size = file_stat.st_size;
+    parser->file_size += 32 - (parser->file_size % 32);
+  }else{
+    perror("Failed to open file:");
+  }
+  
+#elif defined(_WIN32)
+  
+  HANDLE file = CreateFile(parser->filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_READONLY,
+                           NULL);
+ 
+  if(file != INVALID_HANDLE_VALUE){
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    parser->file_size = file_size.QuadPart;
+    parser->file_size += 32 - (parser->file_size % 32);
+
+    CloseHandle(file);
+  }else{
+    perror("Failed to open file:");
+  }
+  
+#endif
+}
+
+static int8_t n1_csv_map_file(n1_CSV_Parser* parser){
+
+#if defined(__linux__)
+
+  int file = open(parser->filename,
+                  O_RDONLY);
+  if(file == -1){
+    perror("Failed to open file:");
+    return N1_CSV_FALSE;
+  }
+
+  const int8_t result = n1_csv_map_handle(parser, file);
+  close(file);
+  
+#elif defined(_WIN32)
+  
+  HANDLE file = CreateFile(parser->filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_READONLY | FILE_FLAG_SEQUENTIAL_SCAN,
+                           NULL);
+  
+  if(file == INVALID_HANDLE_VALUE){
+    perror("Failed to open file:");
+    return N1_CSV_FALSE;
+  }
+
+  const int8_t result = n1_csv_map_handle(parser, file);
+  CloseHandle(file);
+  
+#endif
+
+  return result;
+}
+
+#if defined(__linux__)
+static int8_t n1_csv_map_handle(n1_CSV_Parser* parser, int file){
+
+  struct stat file_stat;
+  if(fstat(file, &file_stat) || !file_stat.st_size || !S_ISREG(file_stat.st_mode)){
+    return N1_CSV_FALSE;
+  }
+  
+  parser->file_size = file_stat.st_size;
+  parser->file_size += 32 - (parser->file_size % 32);
+
+  //tokenizers read up to the padded file_size, which can cross into the page after the file.
+  //Reserve zeroed anonymous pages for the whole range and map the file over the start of it.
+  const size_t page_size   = n1_csv_get_page_size();
+  const size_t mapped_size = (parser->file_size + page_size - 1) & ~(page_size - 1);
+  
+  char* data = (char*)mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(data == MAP_FAILED){
+    perror("Failed to map file:");
+    return N1_CSV_FALSE;
+  }
+
+  if(mmap(data, file_stat.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, file, 0) == MAP_FAILED){
+    perror("Failed to map file:");
+    munmap(data, mapped_size);
+    return N1_CSV_FALSE;
+  }
+
+  madvise(data, mapped_size, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+  madvise(data, mapped_size, MADV_HUGEPAGE);
+#endif
+
+#elif defined(_WIN32)
+static int8_t n1_csv_map_handle(n1_CSV_Parser* parser, HANDLE file){
+
+  if(GetFileType(file) != FILE_TYPE_DISK){
+    return N1_CSV_FALSE;
+  }
+  
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file, &file_size);
+  
+  parser->file_size = file_size.QuadPart;
+  parser->file_size += 32 - (parser->file_size % 32);
+
+  //views are zero filled only up to the end of the last page of the file,
+  //so padding that crosses into the next page can't be mapped.
+  const size_t page_size   = n1_csv_get_page_size();
+  const size_t mapped_size = ((size_t)file_size.QuadPart + page_size - 1) & ~(page_size - 1);
+
+  if(!file_size.QuadPart || mapped_size < parser->file_size){
+    return N1_CSV_FALSE;
+  }
+
+  HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mapping == NULL){
+    perror("Failed to map file:");
+    return N1_CSV_FALSE;
+  }
+
+  char* data = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(data == NULL){
+    perror("Failed to map file:");
+    CloseHandle(mapping);
+    return N1_CSV_FALSE;
+  }
+  
+  parser->file_mapping = mapping;
+  
+#endif
+
+  parser->file_data   = data;
+  parser->data_size   = parser->file_size;
+  parser->mapped_size = mapped_size;
+  
+  return N1_CSV_TRUE;
+}
+
+#if defined(__linux__)
+static int8_t n1_csv_read_handle(n1_CSV_Parser* parser, int file){
+#elif defined(_WIN32)
+static int8_t n1_csv_read_handle(n1_CSV_Parser* parser, HANDLE file){
+#endif
+
+  size_t size     = 0;
+  size_t max_size = 64 * 1024;
+  char*  data     = (char*)n1_csv_malloc(max_size);
+  
+  for(;;){
+    //keep room for the zero padding
+    if(max_size - size < 32 + 1){
+      max_size <<= 1;
+      data      = (char*)n1_csv_realloc(data, max_size);
+    }
+    
+#if defined(__linux__)
+    ssize_t bytes_read = read(file, data + size, max_size - size - 32);
+    if(bytes_read < 0){
+      perror("Failed to read file:");
+      n1_csv_free(data);
+      return N1_CSV_FALSE;
+    }
+#elif defined(_WIN32)
+    DWORD bytes_read = 0;
+    if(!ReadFile(file, data + size, (DWORD)(max_size - size - 32), &bytes_read, NULL) && GetLastError() != ERROR_BROKEN_PIPE){
+      perror("Failed to read file:");
+      n1_csv_free(data);
+      return N1_CSV_FALSE;
+    }
+#endif
+
+    if(!bytes_read){
+      break;
+    }
+    size += bytes_read;
+  }
+
+  parser->file_size = size + 32 - (size % 32);
+  n1_memset(data + size, 0, parser->file_size - size);
+  
+  parser->file_data = data;
+  parser->data_size = parser->file_size;
+  parser->owns_data = N1_CSV_TRUE;
+  
+  return N1_CSV_TRUE;
+}
+
+static void n1_csv_unmap_file(n1_CSV_Parser* parser){
+
+  if(parser->owns_data){
+    n1_csv_free(parser->file_data);
+    
+  }else if(parser->mapped_size){
+    
+#if defined(__linux__)
+
+    munmap(parser->file_data, parser->mapped_size);
+
+#elif defined(_WIN32)
+
+    UnmapViewOfFile(parser->file_data);
+    CloseHandle(parser->file_mapping);
+
+#endif
+  }
+  
+  parser->file_data   = NULL;
+  parser->data_size   = 0;
+  parser->mapped_size = 0;
+  parser->owns_data   = N1_CSV_FALSE;
+}
+
+static uint64_t n1_csv_hash_bytes(uint64_t hash, const void* data, size_t size){
+
+  const uint8_t* at = (const uint8_t*)data;
+  for(size_t i = 0; i < size; i++){
+    hash = (hash ^ at[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static int8_t n1_csv_get_file_info(n1_CSV_Parser* parser, uint64_t* size, int64_t* time){
+
+#if defined(__linux__)
+
+  struct stat file_stat;
+  if(stat(parser->filename, &file_stat)){
+    return N1_CSV_FALSE;
+  }
+  
+  *size = file_stat.st_size;
+  *time = (int64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+  
+#elif defined(_WIN32)
+
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if(!GetFileAttributesEx(parser->filename, GetFileExInfoStandard, &attributes)){
+    return N1_CSV_FALSE;
+  }
+
+  *size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+  *time = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+  
+#endif
+
+  return N1_CSV_TRUE;
+}
+
+static int8_t n1_csv_hash_file(n1_CSV_Parser* parser, uint64_t size, uint64_t* hash){
+
+  const uint64_t block_size = size < N1_CSV_INDEX_HASH_BLOCK_SIZE ? size : N1_CSV_INDEX_HASH_BLOCK_SIZE;
+  const uint64_t step       = N1_CSV_INDEX_HASH_BLOCKS > 1 ? (size - block_size) / (N1_CSV_INDEX_HASH_BLOCKS - 1) : 0;
+
+  *hash = n1_csv_hash_bytes(0xcbf29ce484222325ull, &size, sizeof(size));
+  
+  //mapped files are hashed in place
+  if(parser->file_data && parser->mapped_size && parser->data_size >= size){
+    for(uint32_t i = 0; i < N1_CSV_INDEX_HASH_BLOCKS; i++){
+      *hash = n1_csv_hash_bytes(*hash, parser->file_data + i * step, block_size);
+    }
+    return N1_CSV_TRUE;
+  }
+
+  char buffer[N1_CSV_INDEX_HASH_BLOCK_SIZE];
+  int8_t result = N1_CSV_TRUE;
+  
+#if defined(__linux__)
+
+  int file = open(parser->filename, O_RDONLY);
+  if(file == -1){
+    return N1_CSV_FALSE;
+  }
+
+  for(uint32_t i = 0; result && i < N1_CSV_INDEX_HASH_BLOCKS; i++){
+    result = pread(file, buffer, block_size, (off_t)(i * step)) == (ssize_t)block_size;
+    *hash  = n1_csv_hash_bytes(*hash, buffer, block_size);
+  }
+  close(file);
+  
+#elif defined(_WIN32)
+
+  HANDLE file = CreateFile(parser->filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_READONLY,
+                           NULL);
+  if(file == INVALID_HANDLE_VALUE){
+    return N1_CSV_FALSE;
+  }
+
+  for(uint32_t i = 0; result && i < N1_CSV_INDEX_HASH_BLOCKS; i++){
+    uint64_t   offset     = i * step;
+    DWORD      bytes_read = 0;
+    OVERLAPPED overlapped;
+    n1_memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    
+    result = ReadFile(file, buffer, (DWORD)block_size, &bytes_read, &overlapped) && bytes_read == block_size;
+    *hash  = n1_csv_hash_bytes(*hash, buffer, block_size);
+  }
+  CloseHandle(file);
+  
+#endif
+
+  return result;
+}
+
+static uint64_t n1_csv_hash_settings(n1_CSV_Parser* parser){
+
+  uint64_t hash = 0xcbf29ce484222325ull;
+  
+  if(parser->column_names){
+    hash = n1_csv_hash_bytes(hash, "names", 5);
+    for(uint32_t i = 0; i < parser->column_name_count; i++){
+      hash = n1_csv_hash_bytes(hash, parser->column_names[i], strlen(parser->column_names[i]) + 1);
+    }
+  }else if(parser->column_mask){
+    hash = n1_csv_hash_bytes(hash, "mask", 4);
+    hash = n1_csv_hash_bytes(hash, parser->column_mask, parser->column_mask_size);
+  }
+
+  for(uint32_t i = 0; i < parser->filter_count; i++){
+    const n1_CSV_Filter* filter = parser->filters[i];
+    
+    hash = n1_csv_hash_bytes(hash, &filter->type, sizeof(filter->type));
+    hash = n1_csv_hash_bytes(hash, &filter->column, sizeof(filter->column));
+    hash = n1_csv_hash_bytes(hash, &filter->min, sizeof(filter->min));
+    hash = n1_csv_hash_bytes(hash, &filter->max, sizeof(filter->max));
+    
+    for(uint32_t x = 0; x < filter->value_count; x++){
+      hash = n1_csv_hash_bytes(hash, &filter->values[x].length, sizeof(filter->values[x].length));
+      hash = n1_csv_hash_bytes(hash, filter->values[x].data, filter->values[x].length);
+    }
+  }
+  
+  return hash;
+}
+
+static int8_t n1_csv_init_index_header(n1_CSV_Parser* parser,
+                                       n1_CSV_IndexHeader* header,
+                                       char delim_token,
+                                       char quote_token,
+                                       char row_token){
+
+  n1_memset(header, 0, sizeof(*header));
+  memcpy(header->magic, "n1csvidx", sizeof(header->magic));
+  
+  header->version       = N1_CSV_INDEX_VERSION;
+  header->cell_layout   = parser->cell_layout;
+  header->settings_hash = n1_csv_hash_settings(parser);
+  header->row_interval  = n1_csv_get_row_interval(parser);
+  header->delim_token   = delim_token;
+  header->quote_token   = quote_token;
+  header->row_token     = row_token;
+  
+  return n1_csv_get_file_info(parser, &header->file_size, &header->file_time) &&
+         n1_csv_hash_file(parser, header->file_size, &header->file_hash);
+}
+
+static char* n1_csv_get_index_filename(n1_CSV_Parser* parser, const char* index_filename){
+
+  const char* name   = index_filename ? index_filename : parser->filename;
+  const char* suffix = index_filename ? "" : ".n1idx";
+  
+  size_t len    = strlen(name);
+  char*  result = (char*)n1_csv_malloc(len + strlen(suffix) + 1);
+  memcpy(result, name, len);
+  memcpy(result + len, suffix, strlen(suffix) + 1);
+  
+  return result;
+}
+
+static void n1_csv_release_index(n1_CSV_Parser* parser, int8_t keep_cells){
+
+  if(!parser->index_data){
+    return;
+  }
+
+  n1_CSV_Cell* cell_data   = parser->cell_data;
+  uint64_t*    row_offsets = parser->row_offsets;
+  uint32_t*    column_data = parser->column_data;
+  
+  parser->cell_data   = NULL;
+  parser->row_offsets = NULL;
+  parser->column_data = NULL;
+  parser->max_cells   = 0;
+  parser->max_rows    = 0;
+  
+  if(keep_cells){
+    const uint32_t row_offset_count = n1_csv_get_row_offset_count(parser);
+    
+    parser->row_offsets = (uint64_t*)n1_csv_reserve_buffer(parser->arena,
+                                                           NULL,
+                                                           &parser->max_rows,
+                                                           (uint64_t)row_offset_count * 2 + 64,
+                                                           sizeof(uint64_t));
+    memcpy(parser->row_offsets, row_offsets, row_offset_count * sizeof(uint64_t));
+
+    if(parser->row_interval){
+      //sparse layouts have no cells
+    }else if(column_data){
+      const size_t size   = ((size_t)parser->column_count + 1) * parser->column_stride * sizeof(uint32_t);
+      parser->column_data = (uint32_t*)n1_csv_malloc(size);
+      memcpy(parser->column_data, column_data, size);
+    }else{
+      parser->cell_data = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena,
+                                                              NULL,
+                                                              &parser->max_cells,
+                                                              parser->cell_count * 2 + 256,
+                                                              sizeof(n1_CSV_Cell));
+      memcpy(parser->cell_data, cell_data, parser->cell_count * sizeof(n1_CSV_Cell));
+    }
+  }else{
+    parser->row_count     = 0;
+    parser->column_count  = 0;
+    parser->cell_count    = 0;
+    parser->column_stride = 0;
+    parser->row_interval  = 0;
+  }
+  
+#if defined(__linux__)
+  munmap(parser->index_data, parser->index_size);
+#elif defined(_WIN32)
+  UnmapViewOfFile(parser->index_data);
+  CloseHandle(parser->index_mapping);
+#endif
+  
+  parser->index_data = NULL;
+  parser->index_size = 0;
+}
+
+static int8_t n1_csv_write_index(n1_CSV_Parser* parser, const char* index_filename, n1_CSV_IndexHeader* header){
+
+  char* filename = n1_csv_get_index_filename(parser, index_filename);
+  FILE* file     = fopen(filename, "wb");
+  n1_csv_free(filename);
+  
+  if(!file){
+    perror("Failed to write index:");
+    return N1_CSV_FALSE;
+  }
+
+  header->cell_count   = parser->cell_count;
+  header->row_count    = parser->row_count;
+  header->column_count = parser->column_count;
+
+  //header is written last, so an index that wasn't written completely never loads
+  n1_CSV_IndexHeader empty;
+  n1_memset(&empty, 0, sizeof(empty));
+  
+  int8_t result = fwrite(&empty, sizeof(empty), 1, file) == 1;
+  const uint32_t row_offset_count = n1_csv_get_row_offset_count(parser);
+  result = result && fwrite(parser->row_offsets, sizeof(uint64_t), row_offset_count, file) == row_offset_count;
+
+  if(parser->row_interval){
+    //sparse layouts have no cells
+  }else if(parser->column_data){
+    //columns are written without the spare rows of column_stride
+    for(uint32_t column = 0; result && column <= parser->column_count; column++){
+      result = fwrite(parser->column_data + (size_t)column * parser->column_stride, sizeof(uint32_t), parser->row_count, file) == parser->row_count;
+    }
+  }else{
+    result = result && fwrite(parser->cell_data, sizeof(n1_CSV_Cell), parser->cell_count, file) == parser->cell_count;
+  }
+
+  result = result && !fseek(file, 0, SEEK_SET) && fwrite(header, sizeof(*header), 1, file) == 1;
+  result = !fclose(file) && result;
+  
+  if(!result){
+    perror("Failed to write index:");
+  }
+  return result;
+}
+
+static int8_t n1_csv_map_index(n1_CSV_Parser* parser, const char* index_filename, const n1_CSV_IndexHeader* expected){
+
+  char* filename = n1_csv_get_index_filename(parser, index_filename);
+  char* data     = NULL;
+  size_t size    = 0;
+  
+#if defined(__linux__)
+
+  int file = open(filename, O_RDONLY);
+  n1_csv_free(filename);
+  
+  if(file == -1){
+    return N1_CSV_FALSE;
+  }
+
+  struct stat file_stat;
+  if(!fstat(file, &file_stat) && (size_t)file_stat.st_size >= sizeof(n1_CSV_IndexHeader)){
+    size = file_stat.st_size;
+    data = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if(data == MAP_FAILED){
+      data = NULL;
+    }
+  }
+  close(file);
+  
+#elif defined(_WIN32)
+
+  HANDLE file = CreateFile(filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_READONLY,
+                           NULL);
+  n1_csv_free(filename);
+  
+  if(file == INVALID_HANDLE_VALUE){
+    return N1_CSV_FALSE;
+  }
+
+  HANDLE        mapping = NULL;
+  LARGE_INTEGER file_size;
+  if(GetFileSizeEx(file, &file_size) && (size_t)file_size.QuadPart >= sizeof(n1_CSV_IndexHeader)){
+    size    = (size_t)file_size.QuadPart;
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping){
+      data = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      if(!data){
+        CloseHandle(mapping);
+      }
+    }
+  }
+  CloseHandle(file);
+  
+#endif
+
+  if(!data){
+    return N1_CSV_FALSE;
+  }
+
+  const n1_CSV_IndexHeader* header = (const n1_CSV_IndexHeader*)data;
+
+  uint64_t rows_size  = (uint64_t)header->row_count * sizeof(uint64_t);
+  uint64_t cells_size = header->cell_count * sizeof(n1_CSV_Cell);
+  
+  if(header->cell_layout == N1_CSV_CELL_LAYOUT_COLUMNS){
+    cells_size = ((uint64_t)header->column_count + 1) * header->row_count * sizeof(uint32_t);
+  }else if(header->row_interval){
+    rows_size  = ((uint64_t)header->row_count + header->row_interval - 1) / header->row_interval * sizeof(uint64_t);
+    cells_size = 0;
+  }
+
+  //everything up to cell_count identifies the file and settings
+  const int8_t valid = !memcmp(header, expected, offsetof(n1_CSV_IndexHeader, cell_count)) &&
+    header->delim_token == expected->delim_token &&
+    header->quote_token == expected->quote_token &&
+    header->row_token   == expected->row_token &&
+    size == sizeof(*header) + rows_size + cells_size;
+  
+  if(!valid){
+#if defined(__linux__)
+    munmap(data, size);
+#elif defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+#endif
+    return N1_CSV_FALSE;
+  }
+
+  n1_csv_release_index(parser, N1_CSV_FALSE);
+  n1_csv_give_buffer(parser->arena, parser->cell_data, parser->max_cells * sizeof(n1_CSV_Cell));
+  n1_csv_give_buffer(parser->arena, parser->row_offsets, parser->max_rows * sizeof(uint64_t));
+  n1_csv_free(parser->column_data);
+
+  parser->index_data = data;
+  parser->index_size = size;
+#if defined(_WIN32)
+  parser->index_mapping = mapping;
+#endif
+  
+  parser->row_count    = header->row_count;
+  parser->column_count = header->column_count;
+  parser->cell_count   = header->cell_count;
+  parser->row_offsets  = (uint64_t*)(data + sizeof(*header));
+  parser->max_rows     = parser->row_count;
+  parser->cell_data    = NULL;
+  parser->max_cells    = 0;
+  parser->column_data  = NULL;
+  parser->column_stride = 0;
+  parser->row_interval  = (uint32_t)header->row_interval;
+
+  n1_csv_init_split_row(parser, header->delim_token, header->quote_token, header->row_token);
+  
+  if(parser->row_interval){
+    parser->max_rows = n1_csv_get_row_offset_count(parser);
+  }else if(header->cell_layout == N1_CSV_CELL_LAYOUT_COLUMNS){
+    parser->column_data   = (uint32_t*)(data + sizeof(*header) + rows_size);
+    parser->column_stride = parser->row_count;
+  }else{
+    parser->cell_data     = (n1_CSV_Cell*)(data + sizeof(*header) + rows_size);
+    parser->max_cells     = parser->cell_count;
+  }
+
+  return N1_CSV_TRUE;
+}
+
+static void n1_csv_tokenize_memory(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   void (*tokenize_proc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t),
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   size_t offset,
+                                   size_t bytes_to_read){
+
+  size_t bytes_in_memory = 0;
+  
+  if(offset < parser->data_size){
+    bytes_in_memory = parser->data_size - offset;
+    if(bytes_in_memory > bytes_to_read){
+      bytes_in_memory = bytes_to_read;
+    }
+    
+    tokenize_proc(parser,
+                  tokens,
+                  delim_token,
+                  quote_token,
+                  row_token,
+                  parser->file_data + offset,
+                  offset,
+                  bytes_in_memory);
+  }
+
+  //caller's buffer ends before the padding
+  if(bytes_in_memory < bytes_to_read){
+    char padding[64] = {0};
+    
+    tokenize_proc(parser,
+                  tokens,
+                  delim_token,
+                  quote_token,
+                  row_token,
+                  padding,
+                  offset + bytes_in_memory,
+                  bytes_to_read - bytes_in_memory);
+  }
+}
+
+static void n1_csv_tokenize_paged(n1_CSV_ParseInfo* parse_info){
+
+  n1_CSV_Parser*      parser = parse_info->parser;
+  n1_CSV_TokenStream* tokens = &parse_info->tokens;
+  
+  size_t offset    = parse_info->file_offset;
+
+  if(parser->file_data){
+    //file is in memory, tokenize the whole section in place
+    n1_csv_tokenize_memory(parser,
+                           tokens,
+                           parse_info->tokenize_proc,
+                           parse_info->delim_token,
+                           parse_info->quote_token,
+                           parse_info->row_token,
+                           offset,
+                           parse_info->bytes_to_read);
+    return;
+  }
+  
+  size_t page_size = n1_csv_get_page_size();
+  
+  //sections of a page or less are read the old way, without buffers kept for them
+  n1_CSV_Reader* reader = parse_info->bytes_to_read > page_size ? n1_csv_acquire_reader(parser) : NULL;
+  if(reader){
+    n1_csv_start_reader(reader, offset, offset + parse_info->bytes_to_read);
+
+    uint64_t block_offset;
+    size_t   block_size;
+    char*    block;
+    
+    while((block = n1_csv_next_block(reader, &block_offset, &block_size))){
+      parse_info->tokenize_proc(parser,
+                                tokens,
+                                parse_info->delim_token,
+                                parse_info->quote_token,
+                                parse_info->row_token,
+                                block,
+                                block_offset,
+                                block_size);
+    }
+    
+    n1_csv_release_reader(parser, reader);
+    return;
+  }
+  
+
+  //fread fills buffer entirely, so allocate extra byte for null terminator
+  char*  buffer    = (char*)n1_csv_malloc(page_size + 1);
+  buffer[page_size] = 0;
+  
+  //open file
+#if defined(__linux__)
+  int file = open(parser->filename,
+                  O_RDONLY);
+  if(file == -1){
+    perror("Failed to reopen file:");
+    //abort?
+  }
+
+#elif defined(_WIN32)
+  HANDLE file = CreateFile(parser->filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_READONLY,
+                           NULL);
+  
+  if(file == INVALID_HANDLE_VALUE){
+    perror("Failed to reopen file:");
+    //abort?
+  }
+
+#endif
+  
+#if defined(__linux__)
+  //set file position
+  //fseek(file, (int32_t)offset, SEEK_SET);
+  lseek(file, offset, SEEK_SET);
+#elif defined(_WIN32)
+  SetFilePointer(file, (LONG)offset, ((LONG*)&offset) + 1, FILE_BEGIN);
+#endif
+  
+  
+  const int iterations = (int)(parse_info->bytes_to_read / page_size);
+        
+  for(int i = 0; i < iterations; i++){
+    
+#if defined(__linux__)
+    
+    ssize_t bytes_read = read(file, buffer, page_size);
+    if(bytes_read < 0){
+      bytes_read = 0;
+    }
+    
+#elif defined(_WIN32)
+    
+    DWORD bytes_read = 0;
+    ReadFile(file,
+             buffer,
+             (DWORD)page_size,
+             &bytes_read,
+             NULL);
+    
+#endif
+
+    //padding past the end of file is tokenized as null chars
+    if((size_t)bytes_read < page_size){
+      n1_memset(buffer + bytes_read, 0, page_size - bytes_read);
+    }
+    
+    parse_info->tokenize_proc(parser,
+                              tokens,
+                              parse_info->delim_token,
+                              parse_info->quote_token,
+                              parse_info->row_token,
+                              buffer,
+                              offset,
+                              page_size); 
+    offset += page_size;
+  }
+  
+  {
+#if defined(__linux__)
+    ssize_t bytes_read = read(file, buffer, page_size);
+    if(bytes_read < 0){
+      bytes_read = 0;
+    }
+
+#elif defined(_WIN32)
+    
+    DWORD bytes_read = 0;
+    ReadFile(file,
+             buffer,
+             (DWORD)page_size,
+             &bytes_read,
+             NULL);    
+
+#endif
+
+    //last page is partial, clear what's left of the previous page so it isn't tokenized again
+    if((size_t)bytes_read < page_size){
+      n1_memset(buffer + bytes_read, 0, page_size - bytes_read);
+    }
+    
+    buffer[parse_info->bytes_to_read % page_size] = 0;
+    parse_info->tokenize_proc(parser,
+                              tokens,
+                              parse_info->delim_token,
+                              parse_info->quote_token,
+                              parse_info->row_token,
+                              buffer,
+                              offset,
+                              parse_info->bytes_to_read % page_size);
+  }
+  n1_csv_free(buffer);
+
+#if defined(__linux__)
+  
+  close(file);
+  
+#elif defined(_WIN32)
+  
+  CloseHandle(file);
+  
+#endif
+}
+
+static void n1_csv_tokenize_slow(n1_CSV_Parser* parser,
+                                 n1_CSV_TokenStream* tokens,
+                                 char delim_token,
+                                 char quote_token,
+                                 char row_token,
+                                 char* file_buffer,
+                                 size_t offset,
+                                 size_t bytes_to_read){
+  char*       at  = file_buffer;
+  const char* end = at + bytes_to_read;
+  
+  for(; at < end; at++){
+    const int8_t has_delim = *at == delim_token;
+    const int8_t has_quote = *at == quote_token;
+    const int8_t has_row   = *at == row_token;
+    const int8_t has_null  = *at == 0;
+    const int8_t has_token = has_delim || has_row || has_null;
+
+    if(has_quote){
+      tokens->quote_carry = ~tokens->quote_carry;
+      continue;
+    }
+    
+    if(!has_token){
+      continue;
+    }
+
+    const int8_t is_quoted = tokens->quote_carry && !has_null;
+    
+    if(is_quoted && !tokens->speculative){
+      continue;
+    }
+    
+    n1_CSV_Token token;
+      
+    if(has_null){
+      token.type = N1_CSV_TOKEN_TYPE_NULL;  
+    }else if(has_delim){
+      token.type = N1_CSV_TOKEN_TYPE_DELIM;
+    }else{
+      token.type = N1_CSV_TOKEN_TYPE_ROW;
+    }
+
+    if(is_quoted){
+      token.type |= N1_CSV_TOKEN_TYPE_QUOTED;
+    }
+      
+    token.offset = (uint64_t)(at - file_buffer + offset);
+    tokens->tokens[tokens->token_count++] = token;
+      
+    n1_csv_maybe_realloc_token_stream(tokens);
+      
+    if(has_null){ return; }
+    
+  }
+}
+
+N1_CSV_TARGET("sse2")
+static void n1_csv_tokenize_sse2(n1_CSV_Parser* parser,
+                                 n1_CSV_TokenStream* tokens,
+                                 char delim_token,
+                                 char quote_token,
+                                 char row_token,
+                                 char* file_buffer,
+                                 size_t offset,
+                                 size_t bytes_to_read){
+    
+  const __m128i delim    = _mm_set1_epi8(delim_token);
+  const __m128i quote    = _mm_set1_epi8(quote_token);
+  const __m128i row_sep  = _mm_set1_epi8(row_token);
+  const __m128i nullchar = _mm_set1_epi8(0);
+
+  const char* at  = file_buffer;
+  const char* end = at + bytes_to_read;
+  
+  for(; at < end; at += 64){
+    
+    __m128i  it[4];
+    uint64_t valid_mask = ~0ull;
+    
+    if(end - at >= 64){
+      for(int i = 0; i < 4; i++){
+        it[i] = _mm_loadu_si128((const __m128i*)(at + i * 16));
+      }
+    }else{
+      //last block is partial, copy it so nothing past the end is read
+      char block[64] = {0};
+      memcpy(block, at, end - at);
+      
+      for(int i = 0; i < 4; i++){
+        it[i] = _mm_loadu_si128((const __m128i*)(block + i * 16));
+      }
+      valid_mask = (1ull << (end - at)) - 1;
+    }
+
+    uint64_t delim_mask = 0;
+    uint64_t quote_mask = 0;
+    uint64_t row_mask   = 0;
+    uint64_t null_mask  = 0;
+    
+    for(int i = 0; i < 4; i++){
+      delim_mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(it[i], delim))    << (i * 16);
+      quote_mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(it[i], quote))    << (i * 16);
+      row_mask   |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(it[i], row_sep))  << (i * 16);
+      null_mask  |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(it[i], nullchar)) << (i * 16);
+    }
+    
+    null_mask &= valid_mask;
+    
+    if(!(delim_mask | quote_mask | row_mask | null_mask)){
+      continue;
+    }
+    
+    n1_csv_reserve_token_stream(tokens, 64);
+    n1_csv_emit_block(tokens,
+                      delim_mask,
+                      n1_csv_prefix_xor(quote_mask),
+                      row_mask,
+                      null_mask,
+                      (uint64_t)(at - file_buffer + offset));
+    
+    if(null_mask){ return; }
+  }
+}
+
+N1_CSV_TARGET("avx2,pclmul")
+static void n1_csv_tokenize_avx256(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   char* file_buffer,
+                                   size_t offset,
+                                   size_t bytes_to_read){
+
+  const __m256i delim    = _mm256_set1_epi8(delim_token);
+  const __m256i quote    = _mm256_set1_epi8(quote_token);
+  const __m256i row_sep  = _mm256_set1_epi8(row_token);
+  const __m256i nullchar = _mm256_set1_epi8(0);
+
+  const char* at  = file_buffer;
+  const char* end = at + bytes_to_read;
+  
+  for(; at < end; at += 64){
+    
+    __m256i  lo, hi;
+    uint64_t valid_mask = ~0ull;
+    
+    if(end - at >= 64){
+      lo = _mm256_loadu_si256((const __m256i*)at);
+      hi = _mm256_loadu_si256((const __m256i*)(at + 32));
+    }else{
+      //last block is partial, copy it so nothing past the end is read
+      char block[64] = {0};
+      memcpy(block, at, end - at);
+      
+      lo = _mm256_loadu_si256((const __m256i*)block);
+      hi = _mm256_loadu_si256((const __m256i*)(block + 32));
+      valid_mask = (1ull << (end - at)) - 1;
+    }
+    
+    const uint64_t delim_mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, delim))    | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, delim))    << 32);
+    const uint64_t quote_mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote))    | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote))    << 32);
+    const uint64_t row_mask   = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, row_sep))  | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, row_sep))  << 32);
+    const uint64_t null_mask  = ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nullchar)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nullchar)) << 32)) & valid_mask;
+    
+    if(!(delim_mask | quote_mask | row_mask | null_mask)){
+      continue;
+    }
+    
+    n1_csv_reserve_token_stream(tokens, 64);
+    n1_csv_emit_block(tokens,
+                      delim_mask,
+                      n1_csv_prefix_xor_clmul(quote_mask),
+                      row_mask,
+                      null_mask,
+                      (uint64_t)(at - file_buffer + offset));
+    
+    if(null_mask){ return; }
+  }
+}
+
+N1_CSV_TARGET("avx512f,avx512bw,pclmul")
+static void n1_csv_tokenize_avx512(n1_CSV_Parser* parser,
+                                   n1_CSV_TokenStream* tokens,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   char* file_buffer,
+                                   size_t offset,
+                                   size_t bytes_to_read){
+
+  const __m512i delim    = _mm512_set1_epi8(delim_token);
+  const __m512i quote    = _mm512_set1_epi8(quote_token);
+  const __m512i row_sep  = _mm512_set1_epi8(row_token);
+  const __m512i nullchar = _mm512_setzero_si512();
+
+  const char* at  = file_buffer;
+  const char* end = at + bytes_to_read;
+  
+  for(; at < end; at += 64){
+    
+    __m512i   it;
+    __mmask64 valid_mask = ~0ull;
+    
+    if(end - at >= 64){
+      it = _mm512_loadu_si512((const void*)at);
+    }else{
+      //last block is partial, masked load doesn't touch bytes past the end
+      valid_mask = (1ull << (end - at)) - 1;
+      it = _mm512_maskz_loadu_epi8(valid_mask, at);
+    }
+    
+    const uint64_t delim_mask = _mm512_cmpeq_epi8_mask(it, delim);
+    const uint64_t quote_mask = _mm512_cmpeq_epi8_mask(it, quote);
+    const uint64_t row_mask   = _mm512_cmpeq_epi8_mask(it, row_sep);
+    const uint64_t null_mask  = _mm512_mask_cmpeq_epi8_mask(valid_mask, it, nullchar);
+    
+    if(!(delim_mask | quote_mask | row_mask | null_mask)){
+      continue;
+    }
+    
+    n1_csv_reserve_token_stream(tokens, 64);
+    n1_csv_emit_block(tokens,
+                      delim_mask,
+                      n1_csv_prefix_xor_clmul(quote_mask),
+                      row_mask,
+                      null_mask,
+                      (uint64_t)(at - file_buffer + offset));
+    
+    if(null_mask){ return; }
+  }
+}
+
+static uint32_t n1_csv_get_cpu_features(){
+
+  static uint32_t features;
+
+  if(!features){
+
+    uint32_t result = N1_CSV_CPU_FEATURE_DETECTED;
+    uint32_t leaf1[4]  = {0};
+    uint32_t leaf7[4]  = {0};
+    uint64_t xcr0      = 0;
+    
+#if defined(_MSC_VER)
+    int regs[4];
+    
+    __cpuid(regs, 0);
+    const uint32_t max_leaf = (uint32_t)regs[0];
+    
+    __cpuid(regs, 1);
+    for(int i = 0; i < 4; i++){ leaf1[i] = (uint32_t)regs[i]; }
+    
+    if(max_leaf >= 7){
+      __cpuidex(regs, 7, 0);
+      for(int i = 0; i < 4; i++){ leaf7[i] = (uint32_t)regs[i]; }
+    }
+
+    if(leaf1[2] & (1u << 27)){
+      xcr0 = _xgetbv(0);
+    }
+#else
+    const uint32_t max_leaf = __get_cpuid_max(0, NULL);
+    
+    __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+    
+    if(max_leaf >= 7){
+      __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+    }
+    
+    //os saves the vector registers it has enabled in xcr0
+    if(leaf1[2] & (1u << 27)){
+      uint32_t eax, edx;
+      __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+      xcr0 = ((uint64_t)edx << 32) | eax;
+    }
+#endif
+
+    const int8_t os_avx    = (xcr0 & 0x06) == 0x06;
+    const int8_t os_avx512 = (xcr0 & 0xE6) == 0xE6;
+    
+    if(leaf1[3] & (1u << 26)){ result |= N1_CSV_CPU_FEATURE_SSE2;   }
+    if(leaf1[2] & (1u << 1)) { result |= N1_CSV_CPU_FEATURE_PCLMUL; }
+    
+    if(os_avx && (leaf7[1] & (1u << 5))){
+      result |= N1_CSV_CPU_FEATURE_AVX2;
+    }
+    //avx512bw needs avx512f
+    if(os_avx512 && (leaf7[1] & (1u << 16)) && (leaf7[1] & (1u << 30))){
+      result |= N1_CSV_CPU_FEATURE_AVX512BW;
+    }
+
+    features = result;
+  }
+
+  return features;
+}
+
+static void (*n1_csv_select_tokenizer())(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t){
+
+  const uint32_t features = n1_csv_get_cpu_features();
+  
+  if((features & N1_CSV_CPU_FEATURE_AVX512BW) && (features & N1_CSV_CPU_FEATURE_PCLMUL)){
+    return n1_csv_tokenize_avx512;
+  }
+  if((features & N1_CSV_CPU_FEATURE_AVX2) && (features & N1_CSV_CPU_FEATURE_PCLMUL)){
+    return n1_csv_tokenize_avx256;
+  }
+  if(features & N1_CSV_CPU_FEATURE_SSE2){
+    return n1_csv_tokenize_sse2;
+  }
+  return n1_csv_tokenize_slow;
+}
+
+static int8_t n1_csv_parse_tokens(n1_CSV_Parser* parser,
+                                  uint64_t token_count,
+                                  n1_CSV_Token* tokens,
+                                  uint64_t quote_flag,
+                                  uint64_t* cell_start){
+
+  for(uint64_t token_idx = 0; token_idx < token_count; token_idx++){
+    
+    n1_CSV_Token token = tokens[token_idx];
+    
+    const int8_t selected = !parser->column_mask || (parser->row_column < parser->column_mask_size && parser->column_mask[parser->row_column]);
+    
+    if(token.type == N1_CSV_TOKEN_TYPE_NULL){
+      //file ended with a row separator, don't store the empty row after it
+      if(*cell_start == token.offset && *cell_start == parser->row_offsets[parser->row_count - 1]){
+        parser->row_count --;
+      }else{
+        if(parser->filter_count && !parser->row_rejected){
+          parser->row_rejected = !n1_csv_check_filters(parser, *cell_start, token.offset);
+        }
+        if(selected){
+          n1_csv_push_cell(parser, *cell_start, token.offset);
+        }
+        n1_csv_end_row(parser);
+      }
+
+      //file has only one row
+      if(!parser->column_count){
+        parser->column_count = (uint32_t)parser->cell_count;
+      }
+  
+      return N1_CSV_FALSE;
+    }
+
+    //token is on the wrong side of a quote for where this stream actually started
+    if((token.type & N1_CSV_TOKEN_TYPE_QUOTED) != quote_flag){
+      continue;
+    }
+    
+    if(parser->filter_count && !parser->row_rejected){
+      parser->row_rejected = !n1_csv_check_filters(parser, *cell_start, token.offset);
+    }
+    if(selected && !parser->row_rejected){
+      n1_csv_push_cell(parser, *cell_start, token.offset);
+    }
+    parser->row_column++;
+    *cell_start = token.offset + 1;
+
+    if((token.type & ~N1_CSV_TOKEN_TYPE_QUOTED) == N1_CSV_TOKEN_TYPE_ROW){
+      n1_csv_end_row(parser);
+      
+      //set actual column count after processing the first line
+      if(parser->row_count == 1 && !parser->row_rejected){ 
+        parser->column_count = (uint32_t)parser->cell_count;
+      }
+      n1_csv_push_row(parser, *cell_start);
+    }
+  }
+  return N1_CSV_TRUE;
+}
+
+static uint64_t n1_csv_resolve_section(n1_CSV_ParseInfo* parse_info, uint64_t quote_carry, int8_t first_section){
+
+  n1_CSV_TokenStream* tokens = &parse_info->tokens;
+  
+  parse_info->quote_flag = quote_carry & N1_CSV_TOKEN_TYPE_QUOTED;
+  
+  //find the first row that starts in this section. First section always starts at a row.
+  uint64_t token_idx = 0;
+  
+  parse_info->has_row_start = first_section;
+  
+  if(!first_section){
+    for(; token_idx < tokens->token_count; token_idx++){
+      n1_CSV_Token token = tokens->tokens[token_idx];
+      
+      if(token.type == N1_CSV_TOKEN_TYPE_NULL){
+        token_idx = tokens->token_count;
+        break;
+      }
+      if(token.type == (N1_CSV_TOKEN_TYPE_ROW | parse_info->quote_flag)){
+        parse_info->has_row_start = N1_CSV_TRUE;
+        token_idx ++;
+        break;
+      }
+    }
+  }
+  
+  parse_info->leading_token_count = token_idx;
+  
+  return quote_carry ^ tokens->quote_carry;
+}
+
+static void n1_csv_parse_section(n1_CSV_ParseInfo* parse_info){
+
+  n1_CSV_TokenStream* tokens    = &parse_info->tokens;
+  const uint64_t      token_idx = parse_info->leading_token_count;
+
+  parse_info->reached_end = N1_CSV_FALSE;
+  
+  //no row starts in this section
+  if(!parse_info->has_row_start){
+    return;
+  }
+  
+  uint64_t row_start = token_idx ? tokens->tokens[token_idx - 1].offset + 1 : 0;
+  
+  n1_csv_init_cell_data(&parse_info->section);
+  parse_info->section.row_offsets[0]     = row_start;
+  parse_info->section.cell_layout        = parse_info->parser->cell_layout;
+  parse_info->section.column_mask        = parse_info->parser->column_mask;
+  parse_info->section.column_mask_size   = parse_info->parser->column_mask_size;
+  parse_info->section.filters            = parse_info->parser->filters;
+  parse_info->section.filter_count       = parse_info->parser->filter_count;
+  parse_info->section.filter_quote_token = parse_info->parser->filter_quote_token;
+  parse_info->section.filter_data        = parse_info->parser->filter_data;
+  parse_info->section.filter_data_size   = parse_info->parser->filter_data_size;
+
+  parse_info->cell_start  = row_start;
+  parse_info->reached_end = !n1_csv_parse_tokens(&parse_info->section,
+                                                 tokens->token_count - token_idx,
+                                                 tokens->tokens + token_idx,
+                                                 parse_info->quote_flag,
+                                                 &parse_info->cell_start);
+}
+
+static int8_t n1_csv_merge_section(n1_CSV_Parser* parser, n1_CSV_ParseInfo* parse_info, uint64_t* cell_start){
+
+  if(parser->row_count){
+    if(!n1_csv_parse_tokens(parser,
+                            parse_info->leading_token_count,
+                            parse_info->tokens.tokens,
+                            parse_info->quote_flag,
+                            cell_start)){
+      return N1_CSV_FALSE;
+    }
+
+    //row separator started the section's first row, which the section already has
+    if(parse_info->has_row_start){
+      parser->row_count --;
+    }
+  }
+  
+  if(!parse_info->has_row_start){
+    return N1_CSV_TRUE;
+  }
+
+  //first section always has the first row, unless filters dropped every row before this section
+  if(!parser->column_count){
+    parser->column_count = parse_info->section.column_count;
+  }
+  
+  n1_csv_append_section(parser, &parse_info->section);
+  *cell_start = parse_info->cell_start;
+  
+  return !parse_info->reached_end;
+}
+
+static void n1_csv_append_section(n1_CSV_Parser* parser, n1_CSV_Parser* section){
+
+  //sparse sections only count their cells
+  const int8_t has_cells = section->cell_layout != N1_CSV_CELL_LAYOUT_SPARSE;
+  
+  if(has_cells && parser->cell_count + section->cell_count >= parser->max_cells){
+    parser->cell_data = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena,
+                                                            parser->cell_data,
+                                                            &parser->max_cells,
+                                                            parser->cell_count + section->cell_count + 1,
+                                                            sizeof(n1_CSV_Cell));
+  }
+  
+  if(parser->row_count + section->row_count >= parser->max_rows){
+    parser->row_offsets = (uint64_t*)n1_csv_reserve_buffer(parser->arena,
+                                                           parser->row_offsets,
+                                                           &parser->max_rows,
+                                                           (uint64_t)parser->row_count + section->row_count + 1,
+                                                           sizeof(uint64_t));
+  }
+
+  if(has_cells){
+    memcpy(parser->cell_data + parser->cell_count, section->cell_data, section->cell_count * sizeof(n1_CSV_Cell));
+  }
+  memcpy(parser->row_offsets + parser->row_count, section->row_offsets, section->row_count * sizeof(uint64_t));
+
+  parser->row_first_cell = parser->cell_count + section->row_first_cell;
+  parser->row_rejected   = section->row_rejected;
+  parser->row_column     = section->row_column;
+  
+  parser->cell_count += section->cell_count;
+  parser->row_count  += section->row_count;
+}
+
+static void n1_csv_reset_task_deque(n1_CSV_TaskDeque* deque, int64_t max_tasks){
+
+  deque->top    = 0;
+  deque->bottom = 0;
+  
+  if(max_tasks > deque->max_tasks){
+    deque->max_tasks = max_tasks;
+    deque->tasks     = (int64_t*)n1_csv_realloc(deque->tasks, sizeof(int64_t) * max_tasks);
+  }
+}
+
+static void n1_csv_push_task(n1_CSV_TaskDeque* deque, int64_t task){
+
+  int64_t bottom = n1_csv_atomic_load(&deque->bottom);
+  
+  n1_csv_atomic_store(&deque->tasks[bottom], task);
+  n1_csv_atomic_store(&deque->bottom, bottom + 1);
+}
+
+static int64_t n1_csv_pop_task(n1_CSV_TaskDeque* deque){
+
+  int64_t bottom = n1_csv_atomic_load(&deque->bottom) - 1;
+  n1_csv_atomic_store(&deque->bottom, bottom);
+  n1_csv_atomic_fence();
+  
+  int64_t top = n1_csv_atomic_load(&deque->top);
+  
+  if(top > bottom){
+    n1_csv_atomic_store(&deque->bottom, bottom + 1);
+    return N1_CSV_TASK_NONE;
+  }
+
+  int64_t task = n1_csv_atomic_load(&deque->tasks[bottom]);
+  
+  if(top == bottom){
+    //last task, thieves may be racing for it
+    if(!n1_csv_atomic_compare_exchange(&deque->top, top, top + 1)){
+      task = N1_CSV_TASK_NONE;
+    }
+    n1_csv_atomic_store(&deque->bottom, bottom + 1);
+  }
+  
+  return task;
+}
+
+static int64_t n1_csv_steal_task(n1_CSV_TaskDeque* deque){
+
+  int64_t top = n1_csv_atomic_load(&deque->top);
+  n1_csv_atomic_fence();
+  int64_t bottom = n1_csv_atomic_load(&deque->bottom);
+  
+  if(top >= bottom){
+    return N1_CSV_TASK_NONE;
+  }
+
+  int64_t task = n1_csv_atomic_load(&deque->tasks[top]);
+  
+  if(!n1_csv_atomic_compare_exchange(&deque->top, top, top + 1)){
+    return N1_CSV_TASK_RETRY;
+  }
+  
+  return task;
+}
+
+static int64_t n1_csv_find_task(n1_CSV_Worker* worker){
+
+  n1_CSV_ThreadPool* pool = worker->pool;
+  
+  int64_t task = n1_csv_pop_task(&worker->deque);
+  
+  for(int8_t retry = task == N1_CSV_TASK_NONE; retry;){
+    retry = N1_CSV_FALSE;
+    
+    for(uint32_t i = 0; i < pool->thread_count && task == N1_CSV_TASK_NONE; i++){
+      n1_CSV_TaskDeque* victim = i ? &pool->workers[(worker->index + i) % pool->thread_count].deque : &pool->tasks;
+      
+      task = n1_csv_steal_task(victim);
+      if(task == N1_CSV_TASK_RETRY){
+        task  = N1_CSV_TASK_NONE;
+        retry = N1_CSV_TRUE;
+      }
+    }
+  }
+  
+  return task;
+}
+
+static void n1_csv_thread_pool_proc(n1_CSV_Worker* worker){
+
+  n1_CSV_ThreadPool* pool = worker->pool;
+  uint64_t           seen_epoch = 0;
+  
+  for(;;){
+
+#if defined(__linux__)
+    pthread_mutex_lock(&pool->mutex);
+    while((!pool->running || pool->epoch == seen_epoch) && !pool->shutdown){
+      pthread_cond_wait(&pool->job_ready, &pool->mutex);
+    }
+#elif defined(_WIN32)
+    EnterCriticalSection(&pool->mutex);
+    while((!pool->running || pool->epoch == seen_epoch) && !pool->shutdown){
+      SleepConditionVariableCS(&pool->job_ready, &pool->mutex, INFINITE);
+    }
+#endif
+
+    const int8_t shutdown = pool->shutdown;
+    seen_epoch = pool->epoch;
+    pool->active_workers ++;
+    
+#if defined(__linux__)
+    pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+    LeaveCriticalSection(&pool->mutex);
+#endif
+
+    if(shutdown){
+      return;
+    }
+
+    for(int64_t task = n1_csv_find_task(worker); task != N1_CSV_TASK_NONE; task = n1_csv_find_task(worker)){
+      n1_CSV_ParseInfo* info = (n1_CSV_ParseInfo*)(uintptr_t)(task & ~(int64_t)N1_CSV_TASK_PARSE);
+      
+      if(task & N1_CSV_TASK_PARSE){
+        n1_csv_parse_section(info);
+        n1_csv_atomic_store(&info->parsed, 1);
+      }else{
+        n1_csv_tokenize_paged(info);
+        n1_csv_atomic_store(&info->tokenized, 1);
+      }
+      
+#if defined(__linux__)
+      pthread_mutex_lock(&pool->mutex);
+      n1_csv_atomic_store(&pool->completed, pool->completed + 1);
+      pthread_cond_broadcast(&pool->job_done);
+      pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+      EnterCriticalSection(&pool->mutex);
+      n1_csv_atomic_store(&pool->completed, pool->completed + 1);
+      WakeAllConditionVariable(&pool->job_done);
+      LeaveCriticalSection(&pool->mutex);
+#endif
+    }
+
+#if defined(__linux__)
+    pthread_mutex_lock(&pool->mutex);
+    pool->active_workers --;
+    pthread_cond_broadcast(&pool->job_done);
+    pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+    EnterCriticalSection(&pool->mutex);
+    pool->active_workers --;
+    WakeAllConditionVariable(&pool->job_done);
+    LeaveCriticalSection(&pool->mutex);
+#endif
+  }
+}
+
+static void n1_csv_thread_pool_reserve_infos(n1_CSV_ThreadPool* pool, uint32_t section_count){
+
+  if(section_count > pool->max_infos){
+    pool->infos = (n1_CSV_ParseInfo*)n1_csv_realloc(pool->infos, sizeof(n1_CSV_ParseInfo) * section_count);
+    n1_memset(pool->infos + pool->max_infos, 0, sizeof(n1_CSV_ParseInfo) * (section_count - pool->max_infos));
+    pool->max_infos = section_count;
+  }
+}
+
+static void n1_csv_thread_pool_start(n1_CSV_ThreadPool* pool, uint32_t section_count, int64_t max_tasks){
+
+#if defined(__linux__)
+  pthread_mutex_lock(&pool->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&pool->mutex);
+#endif
+
+  n1_csv_reset_task_deque(&pool->tasks, max_tasks);
+
+  //each worker gets a contiguous run of sections, pushed in reverse so the owner pops them in order
+  for(uint32_t i = 0; i < pool->thread_count; i++){
+    const uint32_t first = (uint32_t)((uint64_t)section_count * i / pool->thread_count);
+    const uint32_t last  = (uint32_t)((uint64_t)section_count * (i + 1) / pool->thread_count);
+    
+    n1_csv_reset_task_deque(&pool->workers[i].deque, last - first + 1);
+    for(uint32_t x = last; x > first; x--){
+      n1_csv_push_task(&pool->workers[i].deque, (int64_t)(uintptr_t)&pool->infos[x - 1] | N1_CSV_TASK_TOKENIZE);
+    }
+  }
+
+  pool->completed = 0;
+  pool->running   = N1_CSV_TRUE;
+  pool->epoch ++;
+  
+#if defined(__linux__)
+  pthread_cond_broadcast(&pool->job_ready);
+  pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+  WakeAllConditionVariable(&pool->job_ready);
+  LeaveCriticalSection(&pool->mutex);
+#endif
+}
+
+static void n1_csv_thread_pool_notify(n1_CSV_ThreadPool* pool){
+
+#if defined(__linux__)
+  pthread_mutex_lock(&pool->mutex);
+  pool->epoch ++;
+  pthread_cond_broadcast(&pool->job_ready);
+  pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&pool->mutex);
+  pool->epoch ++;
+  WakeAllConditionVariable(&pool->job_ready);
+  LeaveCriticalSection(&pool->mutex);
+#endif
+}
+
+static void n1_csv_thread_pool_wait(n1_CSV_ThreadPool* pool, int64_t completed){
+
+#if defined(__linux__)
+  pthread_mutex_lock(&pool->mutex);
+  while(pool->completed == completed){
+    pthread_cond_wait(&pool->job_done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&pool->mutex);
+  while(pool->completed == completed){
+    SleepConditionVariableCS(&pool->job_done, &pool->mutex, INFINITE);
+  }
+  LeaveCriticalSection(&pool->mutex);
+#endif
+}
+
+static void n1_csv_thread_pool_stop(n1_CSV_ThreadPool* pool){
+
+#if defined(__linux__)
+  pthread_mutex_lock(&pool->mutex);
+  pool->running = N1_CSV_FALSE;
+  while(pool->active_workers){
+    pthread_cond_wait(&pool->job_done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+#elif defined(_WIN32)
+  EnterCriticalSection(&pool->mutex);
+  pool->running = N1_CSV_FALSE;
+  while(pool->active_workers){
+    SleepConditionVariableCS(&pool->job_done, &pool->mutex, INFINITE);
+  }
+  LeaveCriticalSection(&pool->mutex);
+#endif
+}
+
+static void n1_csv_stream_push_cell(n1_CSV_StreamState* state, uint64_t start, uint64_t end){
+
+  if(state->cell_count == state->max_cells){
+    state->max_cells    = state->max_cells ? state->max_cells << 1 : 64;
+    state->cell_offsets = (uint64_t*)n1_csv_realloc(state->cell_offsets, sizeof(uint64_t) * 2 * state->max_cells);
+    state->cells        = (n1_CSV_String*)n1_csv_realloc(state->cells, sizeof(n1_CSV_String) * state->max_cells);
+  }
+  
+  state->cell_offsets[2 * state->cell_count + 0] = start;
+  state->cell_offsets[2 * state->cell_count + 1] = end;
+  state->cell_count ++;
+}
+
+static int8_t n1_csv_stream_row(n1_CSV_StreamState* state){
+
+  for(uint32_t i = 0; i < state->cell_count; i++){
+    const uint64_t start = state->cell_offsets[2 * i + 0];
+    const uint64_t end   = state->cell_offsets[2 * i + 1];
+    
+    state->cells[i].data   = state->data + (start - state->data_offset);
+    state->cells[i].length = (uint32_t)(end - start);
+  }
+
+  const int keep_going = state->row_proc(state->user_data, state->row++, state->cells, state->cell_count);
+  state->cell_count = 0;
+  
+  return keep_going != 0;
+}
+
+static int8_t n1_csv_stream_tokens(n1_CSV_StreamState* state, n1_CSV_TokenStream* tokens){
+
+  for(uint64_t token_idx = 0; token_idx < tokens->token_count; token_idx++){
+    
+    n1_CSV_Token token = tokens->tokens[token_idx];
+    
+    if(token.type == N1_CSV_TOKEN_TYPE_NULL){
+      //file ended with a row separator, there is no row after it
+      if(state->cell_count || state->cell_start != token.offset){
+        n1_csv_stream_push_cell(state, state->cell_start, token.offset);
+        n1_csv_stream_row(state);
+      }
+      return N1_CSV_FALSE;
+    }
+    
+    n1_csv_stream_push_cell(state, state->cell_start, token.offset);
+    state->cell_start = token.offset + 1;
+
+    if(token.type == N1_CSV_TOKEN_TYPE_ROW){
+      state->row_start = state->cell_start;
+      
+      if(!n1_csv_stream_row(state)){
+        return N1_CSV_FALSE;
+      }
+    }
+  }
+  return N1_CSV_TRUE;
+}
+
+static void n1_csv_trim_cell(n1_CSV_String* cell, char quote_token){
+  
+  if(cell->length && cell->data[cell->length - 1] == '\r'){
+    cell->length--;
+  }
+  if(cell->length >= 2 && cell->data[0] == quote_token && cell->data[cell->length - 1] == quote_token){
+    cell->data++;
+    cell->length -= 2;
+  }
+}
+
+static int8_t n1_csv_is_eight_digits(uint64_t chars){
+  //every byte is 0x30 .. 0x39
+  return !(((chars & 0xF0F0F0F0F0F0F0F0ull) | (((chars + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ^ 0x3333333333333333ull);
+}
+
+static uint64_t n1_csv_parse_eight_digits(uint64_t chars){
+  
+  chars -= 0x3030303030303030ull;
+  //pairs, then quads, then all 8 digits
+  chars = (chars * 10) + (chars >> 8);
+  chars = (((chars & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+           (((chars >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+  return chars;
+}
+
+static uint32_t n1_csv_parse_digits(const char* at, const char* end, uint32_t max_digits, uint64_t* value){
+
+  const char* start  = at;
+  uint64_t    result = *value;
+  
+  while(end - at >= 8 && (uint32_t)(at - start) + 8 <= max_digits){
+    uint64_t chars;
+    memcpy(&chars, at, 8);
+    
+    if(!n1_csv_is_eight_digits(chars)){
+      break;
+    }
+    result = result * 100000000 + n1_csv_parse_eight_digits(chars);
+    at += 8;
+  }
+  
+  while(at < end && (uint32_t)(at - start) < max_digits && (uint8_t)(*at - '0') < 10){
+    result = result * 10 + (uint8_t)(*at - '0');
+    at++;
+  }
+
+  *value = result;
+  return (uint32_t)(at - start);
+}
+
+static int8_t n1_csv_convert_int64(const char* at, uint32_t length, int64_t* value){
+
+  const char* end      = at + length;
+  int8_t      negative = N1_CSV_FALSE;
+
+  if(at < end && (*at == '-' || *at == '+')){
+    negative = *at == '-';
+    at++;
+  }
+
+  //19 digits always fit in 64 bits
+  uint64_t       result = 0;
+  const uint32_t digits = n1_csv_parse_digits(at, end, 19, &result);
+
+  if(!digits || at + digits != end || result > (uint64_t)INT64_MAX + negative){
+    return N1_CSV_FALSE;
+  }
+
+  *value = negative ? (int64_t)(0 - result) : (int64_t)result;
+  return N1_CSV_TRUE;
+}
+
+static int8_t n1_csv_convert_double(const char* at, uint32_t length, double* value){
+
+  static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  
+  const char* start    = at;
+  const char* end      = at + length;
+  int8_t      negative = N1_CSV_FALSE;
+
+  if(at < end && (*at == '-' || *at == '+')){
+    negative = *at == '-';
+    at++;
+  }
+
+  uint64_t mantissa = 0;
+  int64_t  exponent = 0;
+  uint32_t digits   = n1_csv_parse_digits(at, end, 19, &mantissa);
+  at += digits;
+
+  if(at < end && *at == '.'){
+    at++;
+    const uint32_t fraction = n1_csv_parse_digits(at, end, 19 - digits, &mantissa);
+    at       += fraction;
+    digits   += fraction;
+    exponent -= fraction;
+  }
+
+  if(digits && at < end && (*at == 'e' || *at == 'E')){
+    at++;
+    int8_t negative_exponent = N1_CSV_FALSE;
+    if(at < end && (*at == '-' || *at == '+')){
+      negative_exponent = *at == '-';
+      at++;
+    }
     
-  //fread fills buffer entirely, so allocate extra byte for null terminator
-  char*  buffer    = (char*)n1_csv_malloc(page_size + 1);
-  buffer[page_size] = 0;
+    uint64_t       explicit_exponent = 0;
+    const uint32_t exponent_digits   = n1_csv_parse_digits(at, end, 4, &explicit_exponent);
+    at += exponent_digits;
+    
+    if(!exponent_digits){
+      return N1_CSV_FALSE;
+    }
+    exponent += negative_exponent ? -(int64_t)explicit_exponent : (int64_t)explicit_exponent;
+  }
+
+  //both the mantissa and the power of ten are exact, so one multiply or divide rounds correctly
+  if(digits && at == end && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22){
+    double result = (double)mantissa;
+    result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+    
+    *value = negative ? -result : result;
+    return N1_CSV_TRUE;
+  }
+
+  //more digits, larger exponents, inf and nan
+  char buffer[128];
+  if(!length || length >= sizeof(buffer) || *start == ' '){
+    return N1_CSV_FALSE;
+  }
+  memcpy(buffer, start, length);
+  buffer[length] = 0;
+
+  char* parsed_end;
+  *value = strtod(buffer, &parsed_end);
   
-  //open file
+  return parsed_end == buffer + length;
+}
+
+static int8_t n1_csv_convert_bool(const char* at, uint32_t length, uint8_t* value){
+
+  static const char* names[] = {"0", "false", "no", "f", "n", "1", "true", "yes", "t", "y"};
+  
+  if(!length || length > 5){
+    return N1_CSV_FALSE;
+  }
+  
+  for(uint32_t i = 0; i < sizeof(names) / sizeof(*names); i++){
+    
+    uint32_t x = 0;
+    for(; x < length && names[i][x] && (at[x] | 0x20) == names[i][x]; x++){}
+    
+    if(x == length && !names[i][x]){
+      *value = i >= 5;
+      return N1_CSV_TRUE;
+    }
+  }
+  return N1_CSV_FALSE;
+}
+
+static int64_t n1_csv_days_from_civil(int64_t year, uint32_t month, uint32_t day){
+
+  //years start in march, so the leap day is the last day of a year
+  year -= month <= 2;
+  const int64_t  era         = (year >= 0 ? year : year - 399) / 400;
+  const uint32_t year_of_era = (uint32_t)(year - era * 400);
+  const uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const uint32_t day_of_era  = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  
+  return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+static int8_t n1_csv_convert_timestamp(const char* at, uint32_t length, int64_t* value){
+
+  const char* end = at + length;
+
+  if(end > at && end[-1] == 'Z'){
+    end--;
+  }
+  
+  //fixed width fields, YYYY-MM-DD[(T| )HH:MM[:SS[.ffffff]]]
+  uint64_t year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, micros = 0;
+  
+  if(end - at < 10 ||
+     n1_csv_parse_digits(at, end, 4, &year) != 4 || at[4] != '-' ||
+     n1_csv_parse_digits(at + 5, end, 2, &month) != 2 || at[7] != '-' ||
+     n1_csv_parse_digits(at + 8, end, 2, &day) != 2){
+    return N1_CSV_FALSE;
+  }
+  at += 10;
+
+  if(at < end){
+    if(end - at < 6 || (*at != 'T' && *at != ' ') ||
+       n1_csv_parse_digits(at + 1, end, 2, &hour) != 2 || at[3] != ':' ||
+       n1_csv_parse_digits(at + 4, end, 2, &minute) != 2){
+      return N1_CSV_FALSE;
+    }
+    at += 6;
+    
+    if(at < end){
+      if(end - at < 3 || *at != ':' || n1_csv_parse_digits(at + 1, end, 2, &second) != 2){
+        return N1_CSV_FALSE;
+      }
+      at += 3;
+      
+      if(at < end && *at == '.'){
+        at++;
+        
+        const uint32_t fraction = n1_csv_parse_digits(at, end, 6, &micros);
+        if(!fraction){
+          return N1_CSV_FALSE;
+        }
+        for(uint32_t i = fraction; i < 6; i++){
+          micros *= 10;
+        }
+        at += fraction;
+        
+        //digits past microseconds are dropped
+        while(at < end && (uint8_t)(*at - '0') < 10){
+          at++;
+        }
+      }
+    }
+  }
+
+  if(at != end || month < 1 || month > 12 || day < 1 || hour > 23 || minute > 59 || second > 60){
+    return N1_CSV_FALSE;
+  }
+
+  //february has 29 days in leap years
+  static const uint8_t month_days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  const int8_t leap_year = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  
+  if(day > month_days[month - 1] + (uint64_t)(month == 2 && leap_year)){
+    return N1_CSV_FALSE;
+  }
+
+  const int64_t days    = n1_csv_days_from_civil((int64_t)year, (uint32_t)month, (uint32_t)day);
+  const int64_t seconds = days * 86400 + (int64_t)(hour * 3600 + minute * 60 + second);
+  
+  *value = seconds * 1000000 + (int64_t)micros;
+  return N1_CSV_TRUE;
+}
+
+static void n1_csv_init_parse_info(n1_CSV_ParseInfo* info,
+                                   n1_CSV_Parser* parser,
+                                   uint32_t section_idx,
+                                   size_t bytes_to_read,
+                                   char delim_token,
+                                   char quote_token,
+                                   char row_token,
+                                   void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t)){
+
+  const size_t offset = (size_t)section_idx * bytes_to_read;
+  
+  info->parser             = parser;
+  info->file_offset        = offset;
+  info->bytes_to_read      = bytes_to_read;
+
+  if(info->bytes_to_read + offset > parser->file_size){
+    info->bytes_to_read = parser->file_size - offset;
+  }
+
+  info->delim_token        = delim_token;
+  info->quote_token        = quote_token;
+  info->row_token          = row_token;
+  info->tokens.token_count = 0;
+  info->tokens.quote_carry = 0;
+  info->tokens.speculative = section_idx != 0;
+  info->tokenize_proc      = threadproc;
+  info->tokenized          = 0;
+  info->parsed             = 0;
+  info->reached_end        = N1_CSV_FALSE;
+  info->section.row_count  = 0;
+  info->section.cell_count = 0;
+
+  if(!info->tokens.tokens){
+    info->tokens.tokens      = (n1_CSV_Token*)n1_csv_reserve_buffer(NULL, NULL, &info->tokens.max_tokens, 64, sizeof(n1_CSV_Token));
+  }
+}
+
+static void n1_csv_parse_threaded(n1_CSV_Parser* parser,
+                                  char delim_token,
+                                  char quote_token,
+                                  char row_token,
+                                  void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t)){
+
+  if(!parser->file_size){
+    return;
+  }
+
+  n1_csv_release_index(parser, N1_CSV_FALSE);
+  n1_csv_init_split_row(parser, delim_token, quote_token, row_token);
+  n1_csv_resolve_column_names(parser, delim_token, quote_token, row_token);
+  if(!n1_csv_prepare_filters(parser, quote_token)){
+    return;
+  }
+
+  const size_t   page_size    = n1_csv_get_page_size();
+  const uint32_t processor_count = n1_csv_get_processor_count();
+  
+  uint32_t thread_count = (uint32_t)(parser->file_size / page_size);
+  if(!thread_count){
+    thread_count = 1;
+  }else if(thread_count > processor_count){
+    thread_count = processor_count;
+  }
+
+  n1_CSV_ThreadPool* pool           = parser->thread_pool;
+  n1_CSV_ThreadPool* temporary_pool = NULL;
+
+  uint64_t token_count = 0;
+  uint64_t row_count   = 0;
+  n1_csv_estimate_token_count(parser, delim_token, row_token, &token_count, &row_count);
+  
+  if(pool){
+    thread_count = pool->thread_count;
+  }
+
+  //many small sections, so idle workers can steal from the ones that hit slow parts of the file
+  size_t bytes_to_read = parser->file_size / ((size_t)thread_count * N1_CSV_MORSELS_PER_THREAD);
+  if(thread_count == 1 || bytes_to_read < N1_CSV_MIN_MORSEL_SIZE){
+    bytes_to_read = N1_CSV_MIN_MORSEL_SIZE;
+  }else if(bytes_to_read > N1_CSV_MAX_MORSEL_SIZE){
+    bytes_to_read = N1_CSV_MAX_MORSEL_SIZE;
+  }
+  bytes_to_read += 32 - (bytes_to_read % 32);
+  
+  uint32_t section_count = thread_count > 1 ? (uint32_t)((parser->file_size + bytes_to_read - 1) / bytes_to_read) : 1;
+  if(section_count <= 1){
+    section_count = 1;
+    bytes_to_read = parser->file_size;
+  }
+
+  //sections in flight
+  uint32_t ring_size = thread_count * N1_CSV_MORSELS_PER_THREAD;
+  if(ring_size > section_count){
+    ring_size = section_count;
+  }
+  
+  if(!pool && section_count > 1){
+    temporary_pool = n1_create_csv_thread_pool(thread_count);
+    pool           = temporary_pool;
+  }
+
+  //a single section is parsed on the calling thread
+  n1_CSV_ParseInfo  single_info;
+  n1_CSV_ParseInfo* infos = &single_info;
+  
+  if(pool){
 #if defined(__linux__)
-  int file = open(parser->filename,
-                  O_RDONLY);
-  if(file == -1){
-    perror("Failed to reopen file:");
-    //abort?
+    pthread_mutex_lock(&pool->parse_mutex);
+#elif defined(_WIN32)
+    EnterCriticalSection(&pool->parse_mutex);
+#endif
+
+    n1_csv_thread_pool_reserve_infos(pool, ring_size);
+    infos = pool->infos;
+  }else{
+    //buffers of the calling thread's section come from the parser's arena and go back to it
+    n1_memset(&single_info, 0, sizeof(single_info));
+    single_info.section.arena = parser->arena;
+    single_info.tokens.tokens = (n1_CSV_Token*)n1_csv_reserve_buffer(parser->arena,
+                                                                     NULL,
+                                                                     &single_info.tokens.max_tokens,
+                                                                     token_count + token_count / 8 + 64,
+                                                                     sizeof(n1_CSV_Token));
+  }
+  
+  for(uint32_t i = 0; i < ring_size; i++){
+    n1_csv_init_parse_info(&infos[i], parser, i, bytes_to_read, delim_token, quote_token, row_token, threadproc);
+    
+    //tokens of a section scaled from the estimate, an eighth more in case its rows are longer
+    const uint64_t section_tokens = (uint64_t)((double)token_count * infos[i].bytes_to_read / parser->file_size);
+    n1_csv_reserve_token_stream(&infos[i].tokens, section_tokens + section_tokens / 8);
+  }
+
+  n1_csv_reserve_estimate(parser, token_count, row_count);
+  n1_csv_init_cell_data(parser);
+  parser->row_count = 0;
+
+  uint64_t cell_start = 0;
+  
+  if(section_count == 1){
+    n1_csv_tokenize_paged(infos);
+    n1_csv_resolve_section(infos, 0, N1_CSV_TRUE);
+    n1_csv_parse_section(infos);
+    n1_csv_merge_section(parser, infos, &cell_start);
+    
+  }else{
+    //every section past the first ring is pushed once for tokenizing and every section once for parsing
+    n1_csv_thread_pool_start(pool, ring_size, 2 * (int64_t)section_count - ring_size);
+
+    //Quote state is resolved in order as sections are tokenized, after which the rows of a section can be built.
+    //Parsed sections are merged in order and their infos reused for the next sections.
+    uint64_t quote_carry = 0;
+    uint32_t resolved    = 0;
+    uint32_t merged      = 0;
+    int8_t   run         = N1_CSV_TRUE;
+    
+    while(run && merged < section_count){
+      const int64_t completed = n1_csv_atomic_load(&pool->completed);
+      int8_t        progress  = N1_CSV_FALSE;
+      int8_t        pushed    = N1_CSV_FALSE;
+      
+      for(; resolved < section_count && resolved < merged + ring_size && n1_csv_atomic_load(&infos[resolved % ring_size].tokenized); resolved++){
+        n1_CSV_ParseInfo* info = &infos[resolved % ring_size];
+        
+        quote_carry = n1_csv_resolve_section(info, quote_carry, resolved == 0);
+        
+        if(info->has_row_start){
+          n1_csv_push_task(&pool->tasks, (int64_t)(uintptr_t)info | N1_CSV_TASK_PARSE);
+          pushed = N1_CSV_TRUE;
+        }else{
+          n1_csv_atomic_store(&info->parsed, 1);
+        }
+      }
+
+      for(; run && merged < section_count && n1_csv_atomic_load(&infos[merged % ring_size].parsed); merged++){
+        n1_CSV_ParseInfo* info = &infos[merged % ring_size];
+        
+        run = n1_csv_merge_section(parser, info, &cell_start);
+        
+        //info is free for the section one ring ahead
+        if(run && merged + ring_size < section_count){
+          n1_csv_init_parse_info(info, parser, merged + ring_size, bytes_to_read, delim_token, quote_token, row_token, threadproc);
+          n1_csv_push_task(&pool->tasks, (int64_t)(uintptr_t)info | N1_CSV_TASK_TOKENIZE);
+          pushed = N1_CSV_TRUE;
+        }
+        progress = N1_CSV_TRUE;
+      }
+
+      if(pushed){
+        n1_csv_thread_pool_notify(pool);
+      }
+      
+      if(!progress){
+        n1_csv_thread_pool_wait(pool, completed);
+      }
+    }
+    
+    //workers finish what is left in the deques if the file ended early
+    n1_csv_thread_pool_stop(pool);
   }
 
+  if(pool){
+#if defined(__linux__)
+    pthread_mutex_unlock(&pool->parse_mutex);
 #elif defined(_WIN32)
-  HANDLE file = CreateFile(parser->filename,
-                           GENERIC_READ,
-                           FILE_SHARE_READ,
-                           NULL,
-                           OPEN_EXISTING,
-                           FILE_ATTRIBUTE_READONLY,
-                           NULL);
+    LeaveCriticalSection(&pool->parse_mutex);
+#endif
+  }else{
+    n1_csv_give_buffer(parser->arena, single_info.tokens.tokens, single_info.tokens.max_tokens * sizeof(n1_CSV_Token));
+    n1_csv_give_buffer(parser->arena, single_info.section.cell_data, single_info.section.max_cells * sizeof(n1_CSV_Cell));
+    n1_csv_give_buffer(parser->arena, single_info.section.row_offsets, single_info.section.max_rows * sizeof(uint64_t));
+  }
+
+  if(temporary_pool){
+    n1_destroy_csv_thread_pool(temporary_pool);
+  }
+
+  n1_csv_release_filters(parser);
+  n1_csv_store_columns(parser, 0, 0);
+}
+
+/* API DEFINITIONS */
+
+N1_CSV_STATIC_API struct n1_CSV_Parser* n1_create_csv_parser(const char* filename){
+
+  n1_CSV_Parser* parser = (n1_CSV_Parser*)n1_csv_malloc(sizeof(n1_CSV_Parser));
+  n1_memset(parser, 0, sizeof(*parser));
+
+  //string copy file name
+  size_t len       = strlen(filename);
+  parser->filename = (char*)n1_csv_malloc(len + 1);
+  memcpy(parser->filename, filename, len + 1);
+
+  parser->cache_size      = N1_CSV_PAGE_CACHE_SIZE;
+  parser->read_ahead      = N1_CSV_PAGE_READ_AHEAD;
+  parser->io              = N1_CSV_IO_URING;
+  parser->queue_depth     = N1_CSV_READ_QUEUE_DEPTH;
+  parser->read_block_size = N1_CSV_READ_BLOCK_SIZE;
   
-  if(file == INVALID_HANDLE_VALUE){
-    perror("Failed to reopen file:");
-    //abort?
+  n1_csv_stat_file(parser);
+  
+  return parser;
+}
+
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_mapped(const char* filename){
+
+  n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+
+  if(parser->file_size){
+    n1_csv_map_file(parser);
+  }
+  return parser;
+}
+
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_from_buffer(const char* data, size_t size){
+
+  n1_CSV_Parser* parser = (n1_CSV_Parser*)n1_csv_malloc(sizeof(n1_CSV_Parser));
+  n1_memset(parser, 0, sizeof(*parser));
+
+  parser->file_size = size + 32 - (size % 32);
+  parser->file_data = (char*)data;
+  parser->data_size = size;
+  
+  return parser;
+}
+
+N1_CSV_STATIC_API n1_CSV_Parser* n1_create_csv_parser_from_fd(int fd){
+
+  n1_CSV_Parser* parser = (n1_CSV_Parser*)n1_csv_malloc(sizeof(n1_CSV_Parser));
+  n1_memset(parser, 0, sizeof(*parser));
+
+#if defined(__linux__)
+  int file = fd;
+#elif defined(_WIN32)
+  HANDLE file = (HANDLE)_get_osfhandle(fd);
+#endif
+  
+  if(!n1_csv_map_handle(parser, file)){
+#if defined(__linux__)
+    //regular file that couldn't be mapped is read from the start too
+    struct stat file_stat;
+    if(!fstat(file, &file_stat) && S_ISREG(file_stat.st_mode)){
+      lseek(file, 0, SEEK_SET);
+    }
+#elif defined(_WIN32)
+    if(GetFileType(file) == FILE_TYPE_DISK){
+      SetFilePointer(file, 0, NULL, FILE_BEGIN);
+    }
+#endif
+    
+    parser->file_size = 0;
+    n1_csv_read_handle(parser, file);
+  }
+  
+  return parser;
+}
+
+N1_CSV_STATIC_API void n1_destroy_csv_parser(n1_CSV_Parser* parser){
+
+  n1_csv_release_index(parser, N1_CSV_FALSE);
+  n1_csv_give_buffer(parser->arena, parser->cell_data, parser->max_cells * sizeof(n1_CSV_Cell));
+  n1_csv_free(parser->column_data);
+  n1_csv_free(parser->column_mask);
+  n1_csv_free(parser->column_names);
+  n1_csv_clear_filters(parser);
+  n1_csv_give_buffer(parser->arena, parser->row_offsets, parser->max_rows * sizeof(uint64_t));
+  n1_csv_free(parser->filename);
+
+  n1_csv_unmap_file(parser);
+
+  n1_csv_free(parser->split_row.cells);
+  n1_csv_free(parser->split_row.data);
+  n1_csv_free_buffer(parser->split_row.tokens, parser->split_row.max_tokens * sizeof(n1_CSV_Token));
+  n1_csv_free(parser->batch.cells);
+  n1_csv_free(parser->batch.data);
+  n1_csv_free(parser->batch.ranges);
+  n1_csv_destroy_readers(parser);
+
+  //handle is opened by the first cell read from a file that isn't in memory
+  n1_csv_free(parser->cell_page.data);
+  n1_csv_destroy_page_cache(parser);
+  
+  if(parser->cell_page.file_handle){
+#if defined(__linux__)
+    close(parser->cell_page.file_handle);
+#elif defined(_WIN32)
+    CloseHandle(parser->cell_page.file_handle);
+#endif
+  }
+  
+  n1_csv_free(parser);
+  
+}
+
+N1_CSV_STATIC_API n1_CSV_ThreadPool* n1_create_csv_thread_pool(uint32_t thread_count){
+
+  if(!thread_count){
+    thread_count = n1_csv_get_processor_count();
+  }
+  
+  n1_CSV_ThreadPool* pool = (n1_CSV_ThreadPool*)n1_csv_malloc(sizeof(n1_CSV_ThreadPool));
+  n1_memset(pool, 0, sizeof(*pool));
+
+  pool->thread_count = thread_count;
+  pool->workers      = (n1_CSV_Worker*)n1_csv_malloc(sizeof(n1_CSV_Worker) * thread_count);
+  n1_memset(pool->workers, 0, sizeof(n1_CSV_Worker) * thread_count);
+  
+  for(uint32_t i = 0; i < thread_count; i++){
+    pool->workers[i].pool  = pool;
+    pool->workers[i].index = i;
+  }
+  
+#if defined(__linux__)
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_mutex_init(&pool->parse_mutex, NULL);
+  pthread_cond_init(&pool->job_ready, NULL);
+  pthread_cond_init(&pool->job_done, NULL);
+
+  pool->threads = (pthread_t*)n1_csv_malloc(sizeof(pthread_t) * thread_count);
+  for(uint32_t i = 0; i < thread_count; i++){
+    pthread_create(&pool->threads[i], NULL, (void*(*)(void*))n1_csv_thread_pool_proc, &pool->workers[i]);
   }
+#elif defined(_WIN32)
+  InitializeCriticalSection(&pool->mutex);
+  InitializeCriticalSection(&pool->parse_mutex);
+  InitializeConditionVariable(&pool->job_ready);
+  InitializeConditionVariable(&pool->job_done);
 
+  pool->threads = (HANDLE*)n1_csv_malloc(sizeof(HANDLE) * thread_count);
+  for(uint32_t i = 0; i < thread_count; i++){
+    DWORD id;
+    pool->threads[i] = CreateThread(NULL, 0, (DWORD(*)(void*))n1_csv_thread_pool_proc, &pool->workers[i], 0, &id);
+  }
 #endif
   
+  return pool;
+}
+
+N1_CSV_STATIC_API void n1_destroy_csv_thread_pool(n1_CSV_ThreadPool* pool){
+
 #if defined(__linux__)
-  //set file position
-  //fseek(file, (int32_t)offset, SEEK_SET);
-  lseek(file, offset, SEEK_SET);
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = N1_CSV_TRUE;
+  pthread_cond_broadcast(&pool->job_ready);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for(uint32_t i = 0; i < pool->thread_count; i++){
+    pthread_join(pool->threads[i], NULL);
+  }
+  
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_mutex_destroy(&pool->parse_mutex);
+  pthread_cond_destroy(&pool->job_ready);
+  pthread_cond_destroy(&pool->job_done);
 #elif defined(_WIN32)
-  SetFilePointer(file, (LONG)offset, ((LONG*)&offset) + 1, FILE_BEGIN);
+  EnterCriticalSection(&pool->mutex);
+  pool->shutdown = N1_CSV_TRUE;
+  WakeAllConditionVariable(&pool->job_ready);
+  LeaveCriticalSection(&pool->mutex);
+
+  for(uint32_t i = 0; i < pool->thread_count; i++){
+    WaitForSingleObject(pool->threads[i], INFINITE);
+    CloseHandle(pool->threads[i]);
+  }
+  
+  DeleteCriticalSection(&pool->mutex);
+  DeleteCriticalSection(&pool->parse_mutex);
 #endif
+
+  for(uint32_t i = 0; i < pool->max_infos; i++){
+    n1_csv_free_buffer(pool->infos[i].tokens.tokens, pool->infos[i].tokens.max_tokens * sizeof(n1_CSV_Token));
+    n1_csv_free_buffer(pool->infos[i].section.cell_data, pool->infos[i].section.max_cells * sizeof(n1_CSV_Cell));
+    n1_csv_free_buffer(pool->infos[i].section.row_offsets, pool->infos[i].section.max_rows * sizeof(uint64_t));
+  }
   
+  for(uint32_t i = 0; i < pool->thread_count; i++){
+    n1_csv_free(pool->workers[i].deque.tasks);
+  }
   
-  const int iterations = (int)(parse_info->bytes_to_read / page_size);
-        
-  for(int i = 0; i < iterations; i++){
-    
+  n1_csv_free(pool->threads);
+  n1_csv_free(pool->workers);
+  n1_csv_free(pool->tasks.tasks);
+  n1_csv_free(pool->infos);
+  n1_csv_free(pool);
+}
+
+N1_CSV_STATIC_API void n1_csv_set_thread_pool(n1_CSV_Parser* parser, n1_CSV_ThreadPool* pool){
+  parser->thread_pool = pool;
+}
+
+N1_CSV_STATIC_API n1_CSV_Arena* n1_create_csv_arena(){
+
+  n1_CSV_Arena* arena = (n1_CSV_Arena*)n1_csv_malloc(sizeof(n1_CSV_Arena));
+  n1_memset(arena, 0, sizeof(*arena));
+
 #if defined(__linux__)
-    
-    read(file, buffer, page_size);
-    
+  pthread_mutex_init(&arena->mutex, NULL);
 #elif defined(_WIN32)
-    
-    ReadFile(file,
-             buffer,
-             (DWORD)page_size,
-             NULL,
-             NULL);
-    
+  InitializeCriticalSection(&arena->mutex);
 #endif
-    
-    parse_info->tokenize_proc(parser,
-                              tokens,
-                              parse_info->delim_token,
-                              parse_info->quote_token,
-                              parse_info->row_token,
-                              buffer,
-                              offset,
-                              page_size); 
-    offset += page_size;
-  }
-  
-  {
-#if defined(__linux__)
-    read(file, buffer, page_size);
 
-#elif defined(_WIN32)
-    
-    ReadFile(file,
-             buffer,
-             (DWORD)page_size,
-             NULL,
-             NULL);    
+  return arena;
+}
 
-#endif
-    
-    buffer[parse_info->bytes_to_read % page_size] = 0;
-    parse_info->tokenize_proc(parser,
-                              tokens,
-                              parse_info->delim_token,
-                              parse_info->quote_token,
-                              parse_info->row_token,
-                              buffer,
-                              offset,
-                              parse_info->bytes_to_read % page_size);
+N1_CSV_STATIC_API void n1_destroy_csv_arena(n1_CSV_Arena* arena){
+
+  for(uint32_t i = 0; i < arena->buffer_count; i++){
+    n1_csv_free_buffer(arena->buffers[i].data, arena->buffers[i].size);
   }
-  n1_csv_free(buffer);
 
 #if defined(__linux__)
-  
-  close(file);
-  
+  pthread_mutex_destroy(&arena->mutex);
 #elif defined(_WIN32)
-  
-  CloseHandle(file);
-  
+  DeleteCriticalSection(&arena->mutex);
 #endif
+
+  n1_csv_free(arena);
 }
 
-static void n1_csv_tokenize_slow(n1_CSV_Parser* parser,
-                                 n1_CSV_TokenStream* tokens,
-                                 char delim_token,
-                                 char quote_token,
-                                 char row_token,
-                                 char* file_buffer,
-                                 size_t offset,
-                                 size_t bytes_to_read){
-  char*       at  = file_buffer;
-  const char* end = at + bytes_to_read;
+N1_CSV_STATIC_API void n1_csv_set_arena(n1_CSV_Parser* parser, n1_CSV_Arena* arena){
+  parser->arena = arena;
+}
+
+N1_CSV_STATIC_API uint64_t n1_csv_convert_column(n1_CSV_Parser* parser,
+                                                 uint32_t column,
+                                                 uint32_t first_row,
+                                                 uint32_t row_count,
+                                                 char quote_token,
+                                                 N1_CSV_TYPE type,
+                                                 void* values,
+                                                 uint64_t* null_bitmap){
+
+  uint64_t converted = 0;
+  uint64_t null_bits = 0;
   
-  for(; at < end; at++){
-    const int8_t has_delim = *at == delim_token;
-    const int8_t has_quote = *at == quote_token;
-    const int8_t has_row   = *at == row_token;
-    const int8_t has_null  = *at == 0;
-    const int8_t has_token = has_delim || has_quote || has_row || has_null;
-        
-    if(!has_token){
-      continue;
-    }
+  for(uint32_t i = 0; i < row_count; i++){
+
+    n1_CSV_String cell = n1_csv_get_cell_transient(parser, column, first_row + i);
+    n1_csv_trim_cell(&cell, quote_token);
+
+    int8_t ok = N1_CSV_FALSE;
     
-    n1_CSV_Token token;
-      
-    if(has_null){
-      token.type = N1_CSV_TOKEN_TYPE_NULL;  
-    }else if(has_quote){
-      token.type = N1_CSV_TOKEN_TYPE_QUOTE;
-    }else if(has_delim){
-      token.type = N1_CSV_TOKEN_TYPE_DELIM;
-    }else if(has_row){
-      token.type = N1_CSV_TOKEN_TYPE_ROW;
+    switch(type){
+    case N1_CSV_TYPE_INT64:     ok = n1_csv_convert_int64(cell.data, cell.length, (int64_t*)values + i);     break;
+    case N1_CSV_TYPE_DOUBLE:    ok = n1_csv_convert_double(cell.data, cell.length, (double*)values + i);     break;
+    case N1_CSV_TYPE_BOOL:      ok = n1_csv_convert_bool(cell.data, cell.length, (uint8_t*)values + i);      break;
+    case N1_CSV_TYPE_TIMESTAMP: ok = n1_csv_convert_timestamp(cell.data, cell.length, (int64_t*)values + i); break;
+    case N1_CSV_TYPE_STRING:    break;
+    }
+
+    //value may have been written before the cell turned out to be invalid
+    if(!ok){
+      switch(type){
+      case N1_CSV_TYPE_INT64:
+      case N1_CSV_TYPE_TIMESTAMP: ((int64_t*)values)[i] = 0; break;
+      case N1_CSV_TYPE_DOUBLE:    ((double*)values)[i]  = 0; break;
+      case N1_CSV_TYPE_BOOL:      ((uint8_t*)values)[i] = 0; break;
+      case N1_CSV_TYPE_STRING:    break;
+      }
     }
-      
-    token.offset = (uint32_t)(at - file_buffer + offset);
-    tokens->tokens[tokens->token_count++] = token;
-      
-    n1_csv_maybe_realloc_token_stream(tokens);
-      
-    if(has_null){ return; }
     
+    converted += ok;
+    null_bits |= (uint64_t)!ok << (i & 63);
+
+    if(null_bitmap && ((i & 63) == 63 || i == row_count - 1)){
+      null_bitmap[i >> 6] = null_bits;
+      null_bits = 0;
+    }
   }
+  
+  return converted;
 }
 
-static void n1_csv_tokenize_sse2(n1_CSV_Parser* parser,
-                                 n1_CSV_TokenStream* tokens,
-                                 char delim_token,
-                                 char quote_token,
-                                 char row_token,
-                                 char* file_buffer,
-                                 size_t offset,
-                                 size_t bytes_to_read){
-    
-  const __m128i delim    = _mm_set1_epi8(delim_token);
-  const __m128i quote    = _mm_set1_epi8(quote_token);
-  const __m128i row_sep  = _mm_set1_epi8(row_token);
-  const __m128i nullchar = _mm_set1_epi8(0);
+N1_CSV_STATIC_API uint32_t n1_csv_get_type_size(N1_CSV_TYPE type){
+  
+  switch(type){
+  case N1_CSV_TYPE_INT64:     return sizeof(int64_t);
+  case N1_CSV_TYPE_DOUBLE:    return sizeof(double);
+  case N1_CSV_TYPE_BOOL:      return sizeof(uint8_t);
+  case N1_CSV_TYPE_TIMESTAMP: return sizeof(int64_t);
+  case N1_CSV_TYPE_STRING:    return 0;
+  }
+  return 0;
+}
 
-  const __m128i one = _mm_set1_epi8(1);
-  const __m128i zero = _mm_setzero_si128();
+N1_CSV_STATIC_API n1_CSV_Schema* n1_csv_infer_schema(n1_CSV_Parser* parser,
+                                                     uint32_t first_row,
+                                                     uint32_t sample_rows,
+                                                     char quote_token){
 
-  __m128i*       at  = (__m128i*)(file_buffer);
-  const __m128i* end = (__m128i*)((char*)at + bytes_to_read);
+  const uint32_t column_count = parser->column_count;
   
-  for(; at < end; at++){
-    __m128i it;
-    memcpy(&it, at, sizeof(it));
-    
-    const __m128i has_delim = _mm_cmpeq_epi8(it, delim);
-    const __m128i has_quote = _mm_cmpeq_epi8(it, quote);
-    const __m128i has_row   = _mm_cmpeq_epi8(it, row_sep);
-    const __m128i has_null  = _mm_cmpeq_epi8(it, nullchar);
-    const __m128i has_token = _mm_or_si128(_mm_or_si128(_mm_or_si128(has_delim, has_quote), has_row), has_null);
+  //columns are stored right after the schema
+  n1_CSV_Schema* schema = (n1_CSV_Schema*)n1_csv_malloc(sizeof(n1_CSV_Schema) + column_count * sizeof(n1_CSV_ColumnSchema));
+  schema->column_count  = column_count;
+  schema->sampled_rows  = 0;
+  schema->quote_token   = quote_token;
+  schema->columns       = (n1_CSV_ColumnSchema*)(schema + 1);
+
+  const uint32_t rows = first_row < parser->row_count ? parser->row_count - first_row : 0;
+  if(sample_rows > rows){
+    sample_rows = rows;
+  }
 
+  //bit per type every sampled cell converts to, empty cells convert to anything
+  uint32_t* candidates = (uint32_t*)n1_csv_malloc((column_count ? column_count : 1) * sizeof(uint32_t));
+  
+  for(uint32_t x = 0; x < column_count; x++){
+    candidates[x]                 = (1 << N1_CSV_TYPE_INT64) | (1 << N1_CSV_TYPE_DOUBLE) | (1 << N1_CSV_TYPE_BOOL) | (1 << N1_CSV_TYPE_TIMESTAMP);
+    schema->columns[x].nullable   = N1_CSV_FALSE;
+    schema->columns[x].max_width  = 0;
+  }
+
+  for(uint32_t i = 0; i < sample_rows; i++){
     
-    const __m128i tmp = _mm_sad_epu8(_mm_and_si128(has_token, one), zero);
-    int token_count = ((uint8_t*)&tmp)[0] + ((uint8_t*)&tmp)[8];
-    
-    if(!token_count){
-      continue;
-    }
-    
-    char* file_at = (char*)at;
+    const uint32_t row = first_row + (uint32_t)((uint64_t)i * rows / sample_rows);
     
-    for(int i = 0; i < 16 && token_count; i++, file_at++){
+    for(uint32_t x = 0; x < column_count; x++){
       
-      n1_CSV_Token token;
+      n1_CSV_String cell = n1_csv_get_cell_transient(parser, x, row);
+      n1_csv_trim_cell(&cell, quote_token);
+
+      n1_CSV_ColumnSchema* column = &schema->columns[x];
       
-      if(*file_at == 0){
-        token.type = N1_CSV_TOKEN_TYPE_NULL;  
-      }else if(*file_at == quote_token){
-        token.type = N1_CSV_TOKEN_TYPE_QUOTE;
-        token_count --;
-      }else if(*file_at == delim_token){
-        token.type = N1_CSV_TOKEN_TYPE_DELIM;
-        token_count --;
-      }else if(*file_at == row_token){
-        token.type = N1_CSV_TOKEN_TYPE_ROW;
-        token_count --;
-      }else{
+      if(!cell.length){
+        column->nullable = N1_CSV_TRUE;
         continue;
       }
+      if(cell.length > column->max_width){
+        column->max_width = cell.length;
+      }
       
-      token.offset = (uint32_t)(file_at - file_buffer + offset);
-      tokens->tokens[tokens->token_count++] = token;
-      
-      n1_csv_maybe_realloc_token_stream(tokens);
+      int64_t integer;
+      double  real;
+      uint8_t boolean;
       
-      if(*file_at == 0){ return; }
+      uint32_t types = 0;
+      types |= (uint32_t)(candidates[x] & (1 << N1_CSV_TYPE_INT64)     && n1_csv_convert_int64(cell.data, cell.length, &integer))   << N1_CSV_TYPE_INT64;
+      types |= (uint32_t)(candidates[x] & (1 << N1_CSV_TYPE_DOUBLE)    && n1_csv_convert_double(cell.data, cell.length, &real))     << N1_CSV_TYPE_DOUBLE;
+      types |= (uint32_t)(candidates[x] & (1 << N1_CSV_TYPE_BOOL)      && n1_csv_convert_bool(cell.data, cell.length, &boolean))    << N1_CSV_TYPE_BOOL;
+      types |= (uint32_t)(candidates[x] & (1 << N1_CSV_TYPE_TIMESTAMP) && n1_csv_convert_timestamp(cell.data, cell.length, &integer)) << N1_CSV_TYPE_TIMESTAMP;
       
+      candidates[x] &= types;
     }
   }
+  
+  for(uint32_t x = 0; x < column_count; x++){
+    
+    n1_CSV_ColumnSchema* column = &schema->columns[x];
+
+    //a column without values can't tell its type
+    if(!column->max_width){
+      column->type = N1_CSV_TYPE_STRING;
+    }else if(candidates[x] & (1 << N1_CSV_TYPE_INT64)){
+      column->type = N1_CSV_TYPE_INT64;
+    }else if(candidates[x] & (1 << N1_CSV_TYPE_BOOL)){
+      column->type = N1_CSV_TYPE_BOOL;
+    }else if(candidates[x] & (1 << N1_CSV_TYPE_DOUBLE)){
+      column->type = N1_CSV_TYPE_DOUBLE;
+    }else if(candidates[x] & (1 << N1_CSV_TYPE_TIMESTAMP)){
+      column->type = N1_CSV_TYPE_TIMESTAMP;
+    }else{
+      column->type = N1_CSV_TYPE_STRING;
+    }
+  }
+  
+  schema->sampled_rows = sample_rows;
+  
+  n1_csv_free(candidates);
+  return schema;
 }
 
-static void n1_csv_tokenize_avx256(n1_CSV_Parser* parser,
-                                   n1_CSV_TokenStream* tokens,
-                                   char delim_token,
-                                   char quote_token,
-                                   char row_token,
-                                   char* file_buffer,
-                                   size_t offset,
-                                   size_t bytes_to_read){
-
-  const __m256i delim    = _mm256_set1_epi8(delim_token);
-  const __m256i quote    = _mm256_set1_epi8(quote_token);
-  const __m256i row_sep  = _mm256_set1_epi8(row_token);
-  const __m256i nullchar = _mm256_set1_epi8(0);
-
-  const __m256i one  = _mm256_set1_epi8(1);
-  const __m256i zero = _mm256_setzero_si256();
+N1_CSV_STATIC_API void n1_destroy_csv_schema(n1_CSV_Schema* schema){
+  n1_csv_free(schema);
+}
 
-  __m256i* at  = (__m256i*)(file_buffer);
-  const __m256i* end = (__m256i*)((char*)at + bytes_to_read);
+N1_CSV_STATIC_API uint64_t n1_csv_convert_columns(n1_CSV_Parser* parser,
+                                                  n1_CSV_Schema* schema,
+                                                  uint32_t first_row,
+                                                  uint32_t row_count,
+                                                  void** values,
+                                                  uint64_t** null_bitmaps){
+  uint64_t converted = 0;
   
-  for(; at < end; at++){
-    __m256i it;
-    memcpy(&it, at, sizeof(it));
+  for(uint32_t x = 0; x < schema->column_count; x++){
     
-    const __m256i has_delim = _mm256_cmpeq_epi8(it, delim);
-    const __m256i has_quote = _mm256_cmpeq_epi8(it, quote);
-    const __m256i has_row   = _mm256_cmpeq_epi8(it, row_sep);
-    const __m256i has_null  = _mm256_cmpeq_epi8(it, nullchar);
-    const __m256i has_token = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(has_delim, has_quote), has_row), has_null);
-
-    const __m256i tmp = _mm256_sad_epu8(_mm256_and_si256(has_token, one), zero);
-    int token_count = ((uint8_t*)&tmp)[0] + ((uint8_t*)&tmp)[8] + ((uint8_t*)&tmp)[16] + ((uint8_t*)&tmp)[24];
-
-    if(!token_count){
+    if(schema->columns[x].type == N1_CSV_TYPE_STRING || !values[x]){
       continue;
     }
-    char* file_at = (char*)at;
     
-    for(int i = 0; i < 32 && token_count; i++, file_at++){
-        
-      n1_CSV_Token token;
-        
-      if(*file_at == 0){
-        token.type = N1_CSV_TOKEN_TYPE_NULL;  
-      }else if(*file_at == quote_token){
-        token.type = N1_CSV_TOKEN_TYPE_QUOTE;
-        token_count --;
-      }else if(*file_at == delim_token){
-        token.type = N1_CSV_TOKEN_TYPE_DELIM;
-        token_count --;
-      }else if(*file_at == row_token){
-        token.type = N1_CSV_TOKEN_TYPE_ROW;
-        token_count --;
-      }else{
-        continue;
-      }
-        
-      token.offset = (uint32_t)(file_at - file_buffer + offset);
-      tokens->tokens[tokens->token_count++] = token;
-        
-      n1_csv_maybe_realloc_token_stream(tokens);
-
-      if(*file_at == 0){ return; }
-    }
+    converted += n1_csv_convert_column(parser,
+                                       x,
+                                       first_row,
+                                       row_count,
+                                       schema->quote_token,
+                                       schema->columns[x].type,
+                                       values[x],
+                                       null_bitmaps ? null_bitmaps[x] : NULL);
   }
+  
+  return converted;
 }
 
-static int8_t n1_csv_parse_tokens(n1_CSV_Parser* parser,
-                                  uint32_t token_count,
-                                  n1_CSV_Token* tokens,
-                                  n1_CSV_Token* prev_token,
-                                  int8_t* is_quoted,
-                                  uint32_t* cell_start,
-                                  uint32_t* row_idx,
-                                  int* start_quote_count,
-                                  int* end_quote_count,
-                                  int8_t* is_start_of_cell){
+N1_CSV_STATIC_API void n1_csv_select_columns(n1_CSV_Parser* parser, const uint32_t* columns, uint32_t column_count){
 
-  for(uint32_t token_idx = 0; token_idx < token_count; token_idx++){
-    
-    n1_CSV_Token token = tokens[token_idx];
-    
-    //is token next to previous token
-    int8_t next_to_previous = (prev_token->offset + 1) == token.offset;
+  n1_csv_free(parser->column_mask);
+  n1_csv_free(parser->column_names);
+  parser->column_mask       = NULL;
+  parser->column_mask_size  = 0;
+  parser->column_names      = NULL;
+  parser->column_name_count = 0;
+  
+  if(!column_count){
+    return;
+  }
 
-    if(!next_to_previous){
-      *is_start_of_cell = N1_CSV_FALSE;
+  for(uint32_t i = 0; i < column_count; i++){
+    if(columns[i] >= parser->column_mask_size){
+      parser->column_mask_size = columns[i] + 1;
     }
-      
-    //handle quotation at the start of cell
-    if(token.type == N1_CSV_TOKEN_TYPE_QUOTE){
-      if(*is_start_of_cell){ //if start of cell, keep calculating how many quotes we have
-        if(next_to_previous){
-          (*start_quote_count) ++;
-        }
-      }else{
-        if(!next_to_previous || prev_token->type != N1_CSV_TOKEN_TYPE_QUOTE){
-          (*end_quote_count) = 0;
-        }
-        (*end_quote_count) ++;
-      }
-    }else{
-      *is_start_of_cell = N1_CSV_FALSE;
-      *is_quoted = *start_quote_count % 2;
-      if(prev_token->type == N1_CSV_TOKEN_TYPE_QUOTE && *is_quoted){
-        if(*end_quote_count){
-          *is_quoted = (*end_quote_count % 2) == 0;
-        }
-        *end_quote_count = 0;
-      }
-      
-      if(token.type == N1_CSV_TOKEN_TYPE_NULL){
-        n1_CSV_Cell cell = {
-          *cell_start,
-          token.offset
-        };
-          
-        parser->cell_data[parser->cell_count++] = cell;
-        
-        n1_csv_maybe_realloc_cell_data(parser);
-        *prev_token = token;
+  }
+
+  parser->column_mask = (uint8_t*)n1_csv_malloc(parser->column_mask_size);
+  n1_memset(parser->column_mask, 0, parser->column_mask_size);
   
-        return N1_CSV_FALSE;
-      }
-        
-      else if(token.type == N1_CSV_TOKEN_TYPE_DELIM ||
-              token.type == N1_CSV_TOKEN_TYPE_ROW){
-          
-        if(!*is_quoted){
-          
-          n1_CSV_Cell cell = {
-            *cell_start,
-            token.offset
-          };
-          
-          parser->cell_data[parser->cell_count++] = cell;
-          n1_csv_maybe_realloc_cell_data(parser);
-            
-          *is_start_of_cell = N1_CSV_TRUE;
-          *start_quote_count = 0;
-          *cell_start = token.offset + 1;
-          
-          if(token.type == N1_CSV_TOKEN_TYPE_ROW){
-            //set actual column count after processing the first line
-            if(!*row_idx){ 
-              uint32_t original_column_count = parser->column_count;
-              parser->column_count = (uint32_t)parser->cell_count;
-              parser->row_count    = original_column_count / parser->column_count;
-            }
-            (*row_idx) ++;
-          }
-        }
-      }        
-    }      
-    *prev_token = token;
+  for(uint32_t i = 0; i < column_count; i++){
+    parser->column_mask[columns[i]] = N1_CSV_TRUE;
   }
-  return N1_CSV_TRUE;
 }
 
-static void n1_csv_parse_threaded(n1_CSV_Parser* parser,
-                                  char delim_token,
-                                  char quote_token,
-                                  char row_token,
-                                  void (*threadproc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t)){
+N1_CSV_STATIC_API void n1_csv_select_columns_by_name(n1_CSV_Parser* parser, const char** names, uint32_t name_count){
 
-  if(!parser->file_size){
+  n1_csv_select_columns(parser, NULL, 0);
+
+  if(!name_count){
     return;
   }
 
-  const size_t   page_size    = n1_csv_get_page_size();
-  const uint32_t processor_count = n1_csv_get_processor_count();
-  
-  uint32_t thread_count = (uint32_t)(parser->file_size / page_size);
-  if(!thread_count){
-    thread_count = 1;
-  }else if(thread_count > processor_count){
-    thread_count = processor_count;
+  //pointers followed by the names in one allocation
+  size_t size = name_count * sizeof(char*);
+  for(uint32_t i = 0; i < name_count; i++){
+    size += strlen(names[i]) + 1;
   }
+
+  parser->column_names      = (char**)n1_csv_malloc(size);
+  parser->column_name_count = name_count;
+
+  char* at = (char*)(parser->column_names + name_count);
+  for(uint32_t i = 0; i < name_count; i++){
+    const size_t length = strlen(names[i]) + 1;
+    memcpy(at, names[i], length);
     
-  size_t bytes_to_read = (parser->file_size / thread_count);
-  bytes_to_read += 32 - (bytes_to_read % 32);
+    parser->column_names[i] = at;
+    at += length;
+  }
+}
+
+N1_CSV_STATIC_API void n1_csv_add_filter_equal(n1_CSV_Parser* parser, uint32_t column, const char* value){
+  n1_csv_add_filter_in(parser, column, &value, 1);
+  parser->filters[parser->filter_count - 1]->type = N1_CSV_FILTER_EQUAL;
+}
+
+N1_CSV_STATIC_API void n1_csv_add_filter_prefix(n1_CSV_Parser* parser, uint32_t column, const char* prefix){
+  n1_csv_add_filter_in(parser, column, &prefix, 1);
+  parser->filters[parser->filter_count - 1]->type = N1_CSV_FILTER_PREFIX;
+}
+
+N1_CSV_STATIC_API void n1_csv_add_filter_range(n1_CSV_Parser* parser, uint32_t column, double min, double max){
   
-  size_t offset = 0;
+  n1_CSV_Filter* filter = n1_csv_push_filter(parser, N1_CSV_FILTER_RANGE, column, 0, 0);
+  filter->min = min;
+  filter->max = max;
+}
 
-#if defined(__linux__)
-  pthread_t* threads = (pthread_t*)n1_csv_malloc(sizeof(pthread_t) * thread_count);
-#elif defined(_WIN32)
-  HANDLE* threads = (HANDLE*)n1_csv_malloc(sizeof(HANDLE) * thread_count);
-#endif
+N1_CSV_STATIC_API void n1_csv_add_filter_in(n1_CSV_Parser* parser, uint32_t column, const char** values, uint32_t value_count){
+
+  size_t values_size = 0;
+  for(uint32_t i = 0; i < value_count; i++){
+    values_size += strlen(values[i]);
+  }
   
-  n1_CSV_ParseInfo* infos = (n1_CSV_ParseInfo*)n1_csv_malloc(sizeof(n1_CSV_ParseInfo) * thread_count);
+  n1_CSV_Filter* filter = n1_csv_push_filter(parser, N1_CSV_FILTER_IN, column, value_count, values_size);
   
-  for(uint32_t i = 0; i < thread_count; i++){
-    n1_CSV_ParseInfo* info   = &infos[i];
-    info->parser             = parser;
-    info->file_offset        = offset;
-    info->bytes_to_read     = bytes_to_read;
+  char* at = (char*)(filter->values + value_count);
+  for(uint32_t i = 0; i < value_count; i++){
+    const uint32_t length = (uint32_t)strlen(values[i]);
+    memcpy(at, values[i], length);
+    
+    filter->values[i].data   = at;
+    filter->values[i].length = length;
+    at += length;
+  }
+}
 
-    if(info->bytes_to_read + offset > parser->file_size){
-      info->bytes_to_read = parser->file_size - offset;
-    }
+N1_CSV_STATIC_API void n1_csv_clear_filters(n1_CSV_Parser* parser){
 
-    info->delim_token        = delim_token;
-    info->quote_token        = quote_token;
-    info->row_token          = row_token;
-    info->tokens.token_count = 0;
-    info->tokens.max_tokens  = 64;
-    info->tokens.tokens      = (n1_CSV_Token*)n1_csv_malloc(info->tokens.max_tokens * sizeof(n1_CSV_Token));
-    info->tokenize_proc      = threadproc;
-    
-    offset += bytes_to_read;
-        
-#if defined(__linux__)
-    pthread_create(&threads[i], NULL, (void*(*)(void*))n1_csv_tokenize_paged, &infos[i]);
-#elif defined(_WIN32)
-    DWORD id;
-    threads[i] = CreateThread(NULL, 0, (DWORD(*)(void*))n1_csv_tokenize_paged, &infos[i], 0, &id);
-#endif
+  for(uint32_t i = 0; i < parser->filter_count; i++){
+    n1_csv_free(parser->filters[i]);
   }
+  n1_csv_free(parser->filters);
   
-  parser->column_count  = 256;
-  parser->row_count     = 1;
-  parser->cell_data     = (n1_CSV_Cell*)n1_csv_malloc(sizeof(n1_CSV_Cell) * parser->column_count);
-  
-  //--------------------------
+  parser->filters      = NULL;
+  parser->filter_count = 0;
+}
+
+N1_CSV_STATIC_API void n1_csv_set_cell_layout(n1_CSV_Parser* parser, N1_CSV_CELL_LAYOUT layout){
+  parser->cell_layout = layout;
+}
+
+N1_CSV_STATIC_API void n1_csv_set_row_sampling(n1_CSV_Parser* parser, uint32_t interval){
+  parser->row_sampling = interval;
+}
+
+N1_CSV_STATIC_API void n1_csv_set_page_cache(n1_CSV_Parser* parser, size_t cache_size, uint32_t read_ahead){
+
+  //pages are allocated again for the new size when a cell is read
+  n1_csv_destroy_page_cache(parser);
   
-  n1_CSV_Token prev_token        = {0, 0};
-  int8_t       is_quoted         = N1_CSV_FALSE;
-  uint32_t     cell_start        = 0;
-  uint32_t     row_idx           = 0;
-  int8_t       keep_processing   = N1_CSV_TRUE;
-  int          start_quote_count = 0;
-  int          end_quote_count   = 0;
-  int8_t       is_start_of_cell  = N1_CSV_TRUE;
+  parser->cache_size = cache_size;
+  parser->read_ahead = read_ahead;
+}
 
-  int8_t run = N1_CSV_TRUE;
-  for(uint32_t i = 0; i < thread_count; i++){
-    
-#if defined(__linux__)
-    pthread_join(threads[i], NULL);
-#elif defined(_WIN32)
-    WaitForSingleObject(threads[i], INFINITE);
-#endif
-    if(run)
-      run = n1_csv_parse_tokens(parser,
-                                infos[i].tokens.token_count,
-                                infos[i].tokens.tokens,
-                                &prev_token,
-                                &is_quoted,
-                                &cell_start,
-                                &row_idx,
-                                &start_quote_count,
-                                &end_quote_count,
-                                &is_start_of_cell);
-    n1_csv_free(infos[i].tokens.tokens);
+N1_CSV_STATIC_API void n1_csv_set_io(n1_CSV_Parser* parser, N1_CSV_IO io, uint32_t queue_depth, int8_t direct){
+
+  //readers are created again with the new settings by the next parse
+  n1_csv_destroy_readers(parser);
+
+  if(queue_depth < 1){
+    queue_depth = 1;
+  }else if(queue_depth > N1_CSV_MAX_READ_QUEUE_DEPTH){
+    queue_depth = N1_CSV_MAX_READ_QUEUE_DEPTH;
   }
   
-  n1_csv_free(threads);
-  n1_csv_free(infos);
+  parser->io          = io;
+  parser->queue_depth = queue_depth;
+#if defined(O_DIRECT)
+  parser->io_direct   = direct;
+#else
+  parser->io_direct   = N1_CSV_FALSE;
+#endif
 }
 
-/* API DEFINITIONS */
-
-N1_CSV_STATIC_API struct n1_CSV_Parser* n1_create_csv_parser(const char* filename){
+N1_CSV_STATIC_API void n1_csv_set_read_block_size(n1_CSV_Parser* parser, size_t block_size){
 
-  n1_CSV_Parser* parser = (n1_CSV_Parser*)n1_csv_malloc(sizeof(n1_CSV_Parser));
-  n1_memset(parser, 0, sizeof(*parser));
+  //readers are created again with the new size by the next parse
+  n1_csv_destroy_readers(parser);
 
-  //string copy file name
-  size_t len       = strlen(filename);
-  parser->filename = (char*)n1_csv_malloc(len + 1);
-  memcpy(parser->filename, filename, len + 1);
+  parser->read_block_size = block_size ? block_size : 1;
+}
 
-#if defined(__linux__)
+N1_CSV_STATIC_API void n1_csv_get_page_cache_stats(n1_CSV_Parser* parser, uint64_t* hits, uint64_t* misses){
+  *hits   = parser->page_cache.hits;
+  *misses = parser->page_cache.misses;
+}
 
-  struct stat file_stat;
+N1_CSV_STATIC_API uint64_t n1_csv_get_cells(n1_CSV_Parser* parser, const n1_CSV_CellRef* refs, uint64_t ref_count, n1_CSV_String* cells){
 
-  if(!stat(filename, &file_stat)){
-    parser->file_size = file_stat.st_size;
-    parser->file_size += 32 - (parser->file_size % 32);
-  }else{
-    perror("Failed to open file:");
+  //cells in memory are already stable, split rows point into file_data too
+  if(parser->file_data){
+    uint64_t found = 0;
+    for(uint64_t i = 0; i < ref_count; i++){
+      cells[i] = n1_csv_get_cell_transient(parser, refs[i].column, refs[i].row);
+      found   += cells[i].data != NULL;
+    }
+    return found;
   }
   
-#elif defined(_WIN32)
+  n1_csv_reserve_batch(parser, ref_count);
   
-  HANDLE file = CreateFile(filename,
-                           GENERIC_READ,
-                           FILE_SHARE_READ,
-                           NULL,
-                           OPEN_EXISTING,
-                           FILE_ATTRIBUTE_READONLY,
-                           NULL);
- 
-  if(file != INVALID_HANDLE_VALUE){
-    LARGE_INTEGER file_size;
-    GetFileSizeEx(file, &file_size);
-    parser->file_size = file_size.QuadPart;
-    parser->file_size += 32 - (parser->file_size % 32);
-
-    CloseHandle(file);
-  }else{
-    perror("Failed to open file:");
+  for(uint64_t i = 0; i < ref_count; i++){
+    parser->batch.cells[i].key   = (uint64_t)refs[i].row << 32 | refs[i].column;
+    parser->batch.cells[i].index = i;
   }
   
-#endif
-  return parser;
+  return n1_csv_fetch_batch(parser, ref_count, cells, N1_CSV_FALSE);
 }
 
-N1_CSV_STATIC_API void n1_destroy_csv_parser(n1_CSV_Parser* parser){
-
-  n1_csv_free(parser->cell_data);
-  n1_csv_free(parser->filename);
-
-  if(parser->cell_page.data){
-    n1_csv_free(parser->cell_page.data);
+N1_CSV_STATIC_API uint64_t n1_csv_get_rows(n1_CSV_Parser* parser, uint32_t first_row, uint32_t row_count, n1_CSV_String* cells){
 
-#if defined(__linux__)
-    close(parser->cell_page.file_handle);
-#elif defined(_WIN32)
-    CloseHandle(parser->cell_page.file_handle);
-#endif
+  const uint32_t column_count = parser->column_count;
 
+  //cells in memory are already stable, and rows are split in order
+  if(parser->file_data){
+    uint64_t found = 0;
+    for(uint64_t y = first_row; y < (uint64_t)first_row + row_count; y++){
+      const uint32_t row = y < parser->row_count ? (uint32_t)y : parser->row_count;
+      
+      for(uint32_t x = 0; x < column_count; x++, cells++){
+        *cells = n1_csv_get_cell_transient(parser, x, row);
+        found += cells->data != NULL;
+      }
+    }
+    return found;
   }
   
-  n1_csv_free(parser);
+  n1_csv_reserve_batch(parser, (uint64_t)row_count * column_count);
+  
+  uint64_t i = 0;
+  for(uint32_t y = 0; y < row_count; y++){
+    for(uint32_t x = 0; x < column_count; x++, i++){
+      parser->batch.cells[i].key   = ((uint64_t)first_row + y) << 32 | x;
+      parser->batch.cells[i].index = i;
+    }
+  }
   
+  return n1_csv_fetch_batch(parser, i, cells, N1_CSV_TRUE);
+}
+
+N1_CSV_STATIC_API const uint32_t* n1_csv_get_column(n1_CSV_Parser* parser, uint32_t column){
+
+  if(!parser->column_data || column > parser->column_count){
+    return NULL;
+  }
+  return parser->column_data + (size_t)column * parser->column_stride;
 }
 
 N1_CSV_STATIC_API n1_CSV_String n1_csv_get_cell_transient(n1_CSV_Parser* parser,
                                                           uint32_t column,
                                                           uint32_t row){
 
-  uint64_t idx = parser->column_count * row + column;
+  n1_CSV_String string;
+  string.data   = NULL;
+  string.length = 0;
+
+  uint64_t start;
+  uint32_t length;
+  if(!n1_csv_locate_cell(parser, column, row, &start, &length)){
+    return string;
+  }
+  
+  uint64_t end  = start + length;
+  string.length = length;
+
+  if(parser->file_data){
+    string.data = parser->file_data + start;
+    return string;
+  }
 
-  if(idx >= parser->cell_count){
-    n1_CSV_String string;
-    string.data   = NULL;
-    string.length = 0;
+  //split rows keep the bytes they were read from
+  if(parser->row_interval){
+    string.data = parser->split_row.data + (start - parser->split_row.data_start);
     return string;
   }
 
-  n1_CSV_Cell cell = parser->cell_data[idx];
+  char* cached = n1_csv_read_cached(parser, start, end);
+  if(cached){
+    string.data = cached;
+    return string;
+  }
   
   size_t   page_size = n1_csv_get_page_size();
-  uint32_t page_idx  = cell.start / page_size;
+  uint64_t page_idx  = start / page_size;
 
   n1_CSV_CellPage* page = &parser->cell_page;
 
   int8_t reload_file = N1_CSV_FALSE;
   if(!page->data){
 
-    size_t needed_size = cell.end - (page_idx * page_size);
+    size_t needed_size = end - (page_idx * page_size);
     if(needed_size < page_size){
       needed_size = page_size;
     }
@@ -897,9 +6208,9 @@ N1_CSV_STATIC_API n1_CSV_String n1_csv_get_cell_transient(n1_CSV_Parser* parser,
 
     reload_file             = N1_CSV_TRUE;
 
-  }else if(cell.end > page->end){
+  }else if(start < page->start || end > page->end){
     
-    size_t needed_size = cell.end - (page_idx * page_size);
+    size_t needed_size = end - (page_idx * page_size);
     if(needed_size < page_size){
       needed_size = page_size;
     }
@@ -914,60 +6225,17 @@ N1_CSV_STATIC_API n1_CSV_String n1_csv_get_cell_transient(n1_CSV_Parser* parser,
 
 
   if(reload_file){
+    parser->page_cache.misses++;
     
-    //printf("\n!!!Reload file %d %ld - %ld!!!\n", page_idx, page->start, page->end);
-#if defined(__linux__)
-    
-    if(page->file_handle == 0){
-      page->file_handle = open(parser->filename,
-                               O_RDONLY);
-      
-    }
-    
-    int file = page->file_handle;
-
-    if(file == -1){
-      perror("Failed to open file:");
-      //abort?
-    }
-  
-    lseek(file, (page->start), SEEK_SET);
-    read(file, page->data, page->end - page->start);
-     
-#elif defined(_WIN32)
-    if(page->file_handle == 0){
-      page->file_handle = CreateFile(parser->filename,
-                                     GENERIC_READ,
-                                     FILE_SHARE_READ,
-                                     NULL,
-                                     OPEN_EXISTING,
-                                     FILE_ATTRIBUTE_READONLY,
-                                     NULL);
-    }
-    
-    HANDLE file = page->file_handle;
-
-    if(file == INVALID_HANDLE_VALUE){
-      perror("Failed to open file:");
-      //abort?
-    }
-
-    uint64_t offset = page->start;
-    SetFilePointer(file, (LONG)offset, ((LONG*)&offset) + 1, FILE_BEGIN);
-    ReadFile(file,
-             page->data,
-             page->end - page->start,
-             NULL,
-             NULL);
-#endif
+    //positional read, the handle is shared with the page cache and batch fetches
+    size_t bytes_read = n1_csv_read_file_at(parser, page->data, page->start, page->end - page->start);
+    n1_memset(page->data + bytes_read, 0, page->end - page->start - bytes_read);
+  }else{
+    parser->page_cache.hits++;
   }
   
-  n1_CSV_String string;
-  string.data = page->data + (cell.start - (page_idx * page_size) );
-  string.length = cell.end - cell.start;
-  
+  string.data = page->data + (start - page->start);
   return string;
-  
 }
 
 N1_CSV_STATIC_API void n1_csv_parse_slow(n1_CSV_Parser* parser,
@@ -978,6 +6246,18 @@ N1_CSV_STATIC_API void n1_csv_parse_slow(n1_CSV_Parser* parser,
   if(!parser->file_size){
     return;
   }
+
+  n1_csv_release_index(parser, N1_CSV_FALSE);
+  n1_csv_init_split_row(parser, delim_token, quote_token, row_token);
+  n1_csv_resolve_column_names(parser, delim_token, quote_token, row_token);
+  if(!n1_csv_prepare_filters(parser, quote_token)){
+    return;
+  }
+
+  //the whole file is tokenized into one stream, reserved for the estimate so it doesn't grow as it goes
+  uint64_t token_count = 0;
+  uint64_t row_count   = 0;
+  n1_csv_estimate_token_count(parser, delim_token, row_token, &token_count, &row_count);
   
   n1_CSV_ParseInfo info;
   info.parser             = parser;
@@ -987,37 +6267,32 @@ N1_CSV_STATIC_API void n1_csv_parse_slow(n1_CSV_Parser* parser,
   info.quote_token        = quote_token;
   info.row_token          = row_token;
   info.tokens.token_count = 0;
-  info.tokens.max_tokens  = 64;
-  info.tokens.tokens      = (n1_CSV_Token*)n1_csv_malloc(info.tokens.max_tokens * sizeof(n1_CSV_Token));
+  info.tokens.tokens      = (n1_CSV_Token*)n1_csv_reserve_buffer(parser->arena,
+                                                                 NULL,
+                                                                 &info.tokens.max_tokens,
+                                                                 token_count + token_count / 8 + 64,
+                                                                 sizeof(n1_CSV_Token));
+  info.tokens.quote_carry = 0;
+  info.tokens.speculative = N1_CSV_FALSE;
   info.tokenize_proc      = n1_csv_tokenize_slow;
 
   n1_csv_tokenize_paged(&info);
   
-  parser->column_count  = 256;
-  parser->row_count     = 1;
-  parser->cell_data     = (n1_CSV_Cell*)n1_csv_malloc(sizeof(n1_CSV_Cell) * parser->column_count);
+  n1_csv_reserve_estimate(parser, token_count, row_count);
+  n1_csv_init_cell_data(parser);
   
-  n1_CSV_Token prev_token        = {0,0};
-  int8_t       is_quoted         = N1_CSV_FALSE;
-  uint32_t     cell_start        = 0;
-  uint32_t     row_idx           = 0;
-  int8_t       keep_processing   = N1_CSV_TRUE;
-  int          start_quote_count = 0;
-  int          end_quote_count   = 0;
-  int8_t       is_start_of_cell  = N1_CSV_TRUE;
+  uint64_t cell_start = 0;
   
   n1_csv_parse_tokens(parser,
                       info.tokens.token_count,
                       info.tokens.tokens,
-                      &prev_token,
-                      &is_quoted,
-                      &cell_start,
-                      &row_idx,
-                      &start_quote_count,
-                      &end_quote_count,
-                      &is_start_of_cell);
+                      0,
+                      &cell_start);
   
-  n1_csv_free(info.tokens.tokens);
+  n1_csv_give_buffer(parser->arena, info.tokens.tokens, info.tokens.max_tokens * sizeof(n1_CSV_Token));
+
+  n1_csv_release_filters(parser);
+  n1_csv_store_columns(parser, 0, 0);
 }
 
 N1_CSV_STATIC_API void n1_csv_parse_threaded_slow(n1_CSV_Parser* parser,
@@ -1053,5 +6328,323 @@ N1_CSV_STATIC_API void n1_csv_parse_threaded_avx256(n1_CSV_Parser* parser,
                         n1_csv_tokenize_avx256);
 }
 
+N1_CSV_STATIC_API void n1_csv_parse_threaded_avx512(n1_CSV_Parser* parser,
+                                                    char delim_token,
+                                                    char quote_token,
+                                                    char row_token){
+  n1_csv_parse_threaded(parser,
+                        delim_token,
+                        quote_token,
+                        row_token,
+                        n1_csv_tokenize_avx512);
+}
+
+N1_CSV_STATIC_API void n1_csv_parse_auto(n1_CSV_Parser* parser,
+                                         char delim_token,
+                                         char quote_token,
+                                         char row_token){
+  n1_csv_parse_threaded(parser,
+                        delim_token,
+                        quote_token,
+                        row_token,
+                        n1_csv_select_tokenizer());
+}
+
+N1_CSV_STATIC_API void n1_csv_refresh(n1_CSV_Parser* parser,
+                                      char delim_token,
+                                      char quote_token,
+                                      char row_token){
+
+  if(!parser->filename){
+    return;
+  }
+
+  //new rows are added to the cells of a loaded index
+  n1_csv_release_index(parser, N1_CSV_TRUE);
+  n1_csv_init_split_row(parser, delim_token, quote_token, row_token);
+
+  //mapping is redone for the new size
+  if(parser->mapped_size){
+    n1_csv_unmap_file(parser);
+    if(!n1_csv_map_file(parser)){
+      n1_csv_stat_file(parser);
+    }
+  }else{
+    n1_csv_stat_file(parser);
+  }
+
+  //cached page may end at the old end of file
+  parser->cell_page.start = 0;
+  parser->cell_page.end   = 0;
+  n1_csv_clear_page_cache(parser);
+
+  //offset of the last row isn't kept when rows are sampled
+  if(!parser->row_count || parser->row_interval > 1 || parser->file_size <= parser->row_offsets[parser->row_count - 1]){
+    n1_csv_parse_auto(parser, delim_token, quote_token, row_token);
+    return;
+  }
+
+  if(!n1_csv_prepare_filters(parser, quote_token)){
+    return;
+  }
+
+  //drop the last row and parse again from its start, where quotes are always closed
+  const uint32_t last_row   = parser->row_count - 1;
+  const uint64_t row_start  = parser->row_offsets[last_row];
+  uint64_t       first_cell = (uint64_t)last_row * parser->column_count;
+  
+  if(first_cell > parser->cell_count){
+    first_cell = parser->cell_count;
+  }
+  
+  parser->row_count  = last_row;
+  parser->cell_count = first_cell;
+  if(!parser->row_count){
+    parser->column_count = 0;
+  }
+
+  //cells of the new rows go through cell_data and are moved to the columns after parsing
+  if(parser->column_data){
+    parser->cell_count = 0;
+    if(!parser->cell_data){
+      parser->cell_data = (n1_CSV_Cell*)n1_csv_reserve_buffer(parser->arena, NULL, &parser->max_cells, 256, sizeof(n1_CSV_Cell));
+    }
+  }
+  
+  n1_CSV_ParseInfo info;
+  info.parser             = parser;
+  info.file_offset        = row_start;
+  info.bytes_to_read      = parser->file_size - row_start;
+  info.delim_token        = delim_token;
+  info.quote_token        = quote_token;
+  info.row_token          = row_token;
+  info.tokens.token_count = 0;
+  info.tokens.tokens      = (n1_CSV_Token*)n1_csv_reserve_buffer(parser->arena, NULL, &info.tokens.max_tokens, 64, sizeof(n1_CSV_Token));
+  info.tokens.quote_carry = 0;
+  info.tokens.speculative = N1_CSV_FALSE;
+  info.tokenize_proc      = n1_csv_select_tokenizer();
+
+  n1_csv_tokenize_paged(&info);
+
+  n1_csv_push_row(parser, row_start);
+  
+  uint64_t cell_start = row_start;
+  
+  n1_csv_parse_tokens(parser,
+                      info.tokens.token_count,
+                      info.tokens.tokens,
+                      0,
+                      &cell_start);
+  
+  n1_csv_give_buffer(parser->arena, info.tokens.tokens, info.tokens.max_tokens * sizeof(n1_CSV_Token));
+  n1_csv_release_filters(parser);
+
+  if(parser->column_data){
+    n1_csv_store_columns(parser, last_row, first_cell);
+  }
+}
+
+N1_CSV_STATIC_API int n1_csv_save_index(n1_CSV_Parser* parser,
+                                        const char* index_filename,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token){
+
+  if(!parser->filename){
+    return N1_CSV_FALSE;
+  }
+
+  //the index may be the file being written
+  n1_csv_release_index(parser, N1_CSV_TRUE);
+  
+  n1_CSV_IndexHeader header;
+  if(!n1_csv_init_index_header(parser, &header, delim_token, quote_token, row_token)){
+    return N1_CSV_FALSE;
+  }
+  
+  return n1_csv_write_index(parser, index_filename, &header);
+}
+
+N1_CSV_STATIC_API int n1_csv_load_index(n1_CSV_Parser* parser,
+                                        const char* index_filename,
+                                        char delim_token,
+                                        char quote_token,
+                                        char row_token){
+
+  n1_CSV_IndexHeader expected;
+  
+  return parser->filename &&
+    n1_csv_init_index_header(parser, &expected, delim_token, quote_token, row_token) &&
+    n1_csv_map_index(parser, index_filename, &expected);
+}
+
+N1_CSV_STATIC_API void n1_csv_parse_cached(n1_CSV_Parser* parser,
+                                           const char* index_filename,
+                                           char delim_token,
+                                           char quote_token,
+                                           char row_token){
+
+  //the key is taken before parsing, so a file that changes while it is parsed isn't saved as unchanged
+  n1_CSV_IndexHeader header;
+  const int8_t has_key = parser->filename && n1_csv_init_index_header(parser, &header, delim_token, quote_token, row_token);
+
+  if(has_key && n1_csv_map_index(parser, index_filename, &header)){
+    return;
+  }
+
+  n1_csv_parse_auto(parser, delim_token, quote_token, row_token);
+
+  if(has_key){
+    n1_csv_write_index(parser, index_filename, &header);
+  }
+}
+
+N1_CSV_STATIC_API void n1_csv_parse_stream(n1_CSV_Parser* parser,
+                                           char delim_token,
+                                           char quote_token,
+                                           char row_token,
+                                           n1_CSV_RowProc row_proc,
+                                           void* user_data){
+
+  if(!parser->file_size){
+    return;
+  }
+
+  n1_CSV_StreamState state;
+  n1_memset(&state, 0, sizeof(state));
+  state.row_proc  = row_proc;
+  state.user_data = user_data;
+
+  //stream starts at the beginning of the file, so quote state is always known
+  n1_CSV_TokenStream tokens;
+  tokens.token_count = 0;
+  tokens.tokens      = (n1_CSV_Token*)n1_csv_reserve_buffer(NULL, NULL, &tokens.max_tokens, 64, sizeof(n1_CSV_Token));
+  tokens.quote_carry = 0;
+  tokens.speculative = N1_CSV_FALSE;
+
+  //window holds the unfinished row followed by the bytes being tokenized
+  char*  window      = NULL;
+  size_t max_window  = 0;
+
+  void (*tokenize_proc)(n1_CSV_Parser*, n1_CSV_TokenStream*, char, char, char, char*, size_t, size_t) = n1_csv_select_tokenizer();
+  
+#if defined(__linux__)
+  int file = -1;
+#elif defined(_WIN32)
+  HANDLE file = INVALID_HANDLE_VALUE;
+#endif
+  
+  if(parser->file_data){
+    state.data        = parser->file_data;
+    state.data_offset = 0;
+  }else{
+#if defined(__linux__)
+    file = open(parser->filename, O_RDONLY);
+    if(file == -1){
+      perror("Failed to reopen file:");
+      n1_csv_free_buffer(tokens.tokens, tokens.max_tokens * sizeof(n1_CSV_Token));
+      return;
+    }
+#elif defined(_WIN32)
+    file = CreateFile(parser->filename,
+                      GENERIC_READ,
+                      FILE_SHARE_READ,
+                      NULL,
+                      OPEN_EXISTING,
+                      FILE_ATTRIBUTE_READONLY,
+                      NULL);
+    
+    if(file == INVALID_HANDLE_VALUE){
+      perror("Failed to reopen file:");
+      n1_csv_free_buffer(tokens.tokens, tokens.max_tokens * sizeof(n1_CSV_Token));
+      return;
+    }
+#endif
+  }
+  
+  int8_t run = N1_CSV_TRUE;
+  
+  for(size_t offset = 0; run && offset < parser->file_size;){
+    
+    size_t bytes_to_read = parser->file_size - offset;
+    if(bytes_to_read > N1_CSV_STREAM_WINDOW_SIZE){
+      bytes_to_read = N1_CSV_STREAM_WINDOW_SIZE;
+    }
+
+    tokens.token_count = 0;
+    
+    if(parser->file_data){
+      n1_csv_tokenize_memory(parser,
+                             &tokens,
+                             tokenize_proc,
+                             delim_token,
+                             quote_token,
+                             row_token,
+                             offset,
+                             bytes_to_read);
+    }else{
+      //move the unfinished row to the start of the window
+      const size_t row_length = offset - state.row_start;
+      
+      if(row_length + bytes_to_read > max_window){
+        max_window = row_length + bytes_to_read;
+        char* new_window = (char*)n1_csv_malloc(max_window);
+        if(window){
+          memcpy(new_window, window + (state.row_start - state.data_offset), row_length);
+          n1_csv_free(window);
+        }
+        window = new_window;
+      }else{
+        memmove(window, window + (state.row_start - state.data_offset), row_length);
+      }
+      
+      state.data        = window;
+      state.data_offset = state.row_start;
+      
+      char* buffer      = window + row_length;
+
+#if defined(__linux__)
+      ssize_t bytes_read = read(file, buffer, bytes_to_read);
+      if(bytes_read < 0){
+        bytes_read = 0;
+      }
+#elif defined(_WIN32)
+      DWORD bytes_read = 0;
+      ReadFile(file, buffer, (DWORD)bytes_to_read, &bytes_read, NULL);
+#endif
+
+      //padding past the end of file is tokenized as null chars
+      if((size_t)bytes_read < bytes_to_read){
+        n1_memset(buffer + bytes_read, 0, bytes_to_read - bytes_read);
+      }
+      
+      tokenize_proc(parser,
+                    &tokens,
+                    delim_token,
+                    quote_token,
+                    row_token,
+                    buffer,
+                    offset,
+                    bytes_to_read);
+    }
+    
+    run     = n1_csv_stream_tokens(&state, &tokens);
+    offset += bytes_to_read;
+  }
+
+  if(!parser->file_data){
+#if defined(__linux__)
+    close(file);
+#elif defined(_WIN32)
+    CloseHandle(file);
+#endif
+  }
+  
+  n1_csv_free(window);
+  n1_csv_free(state.cell_offsets);
+  n1_csv_free(state.cells);
+  n1_csv_free_buffer(tokens.tokens, tokens.max_tokens * sizeof(n1_CSV_Token));
+}
+
 #endif
 #endif
@@ -9,7 +9,7 @@ WARNINGS="-Wformat=2
           -Wsign-compare 
           -Werror"
 
-COMPILER_FLAGS="-mavx2"
+COMPILER_FLAGS=""
 INCLUDE_FOLDERS="-I ../
                  -I ./dependencies/"
 
@@ -1,3 +1,6 @@
+//small morsels, so threaded parses of the test files are split into many sections
+#define N1_CSV_MIN_MORSEL_SIZE (4 * 1024)
+
 #define N1_CSV_IMPLEMENTATION
 #include "n1_csv_parser.h"
 
@@ -25,12 +28,12 @@
 
 #endif
 
-void test_csv(const char* filename, void (*parsefunc)(struct n1_CSV_Parser* parser, char delim, char quote, char newline), const char* info){
+void test_csv(const char* filename, struct n1_CSV_Parser* (*createfunc)(const char* filename), void (*parsefunc)(struct n1_CSV_Parser* parser, char delim, char quote, char newline), const char* info){
 
   const int iter = 1;
   for(int i = 0; i < iter; i++){
     uint64_t start = n1_gettimestamp_microseconds();
-    struct n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+    struct n1_CSV_Parser* parser = createfunc(filename);
     if(!parser->file_size){
       n1_destroy_csv_parser(parser);
       return;
@@ -65,10 +68,1080 @@ void test_csv(const char* filename, void (*parsefunc)(struct n1_CSV_Parser* pars
   }
 }
 
-int main(){
+typedef struct StreamInfo{
+  struct n1_CSV_Parser* parser;
+  uint64_t              cell_count;
+  uint64_t              mismatches;
+} StreamInfo;
+
+int stream_row(void* user_data, uint64_t row, n1_CSV_String* cells, uint32_t cell_count){
+  StreamInfo* info = (StreamInfo*)user_data;
+  
+  for(uint32_t i = 0; i < cell_count; i++){
+    n1_CSV_String s = n1_csv_get_cell_transient(info->parser, i, (uint32_t)row);
+    if(!s.data || s.length != cells[i].length || memcmp(s.data, cells[i].data, s.length)){
+      info->mismatches++;
+    }
+  }
+  info->cell_count += cell_count;
+  return 1;
+}
+
+//Streams the file and checks every row against a threaded parse.
+int8_t test_stream(const char* filename, struct n1_CSV_Parser* (*createfunc)(const char* filename), const char* info){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  if(!parser->file_size){
+    n1_destroy_csv_parser(parser);
+    return 1;
+  }
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  StreamInfo stream_info = {parser, 0, 0};
+  struct n1_CSV_Parser* stream_parser = createfunc(filename);
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  n1_csv_parse_stream(stream_parser, ',', '"', '\n', stream_row, &stream_info);
+  uint64_t end = n1_gettimestamp_microseconds();
+  uint64_t time = (end - start);
+  
+  printf("%s | %.4f MB | | | %lu | '%s' |  %f | %f \n",
+         filename,
+         parser->file_size / (1024.0 * 1024.0),
+         (unsigned long)stream_info.cell_count,
+         info,
+         (double)time / 1000.0,
+         (double)(parser->file_size / 1024.0 / 1024.0) / (time / 1000000.0));
+  
+  const int8_t ok = stream_info.cell_count == parser->cell_count && !stream_info.mismatches;
+  if(!ok){
+    printf("stream test FAILED\n");
+  }
+  
+  n1_destroy_csv_parser(stream_parser);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+int8_t compare_parsers(struct n1_CSV_Parser* a, struct n1_CSV_Parser* b){
+  
+  if(a->row_count != b->row_count || a->column_count != b->column_count || a->cell_count != b->cell_count){
+    return 0;
+  }
+  for(uint32_t i = 0; i < a->row_count; i++){
+    for(uint32_t x = 0; x < a->column_count; x++){
+      n1_CSV_String s0 = n1_csv_get_cell_transient(a, x, i);
+      n1_CSV_String s1 = n1_csv_get_cell_transient(b, x, i);
+      
+      if(!s0.data != !s1.data || s0.length != s1.length || (s0.data && memcmp(s0.data, s1.data, s0.length))){
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+//Parses the file from a memory buffer and from an fd and checks them against a mapped parse.
+int8_t test_memory_sources(const char* filename){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  if(!parser->file_size){
+    n1_destroy_csv_parser(parser);
+    return 1;
+  }
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  FILE* file = fopen(filename, "rb");
+  fseek(file, 0, SEEK_END);
+  size_t size = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char* buffer = (char*)malloc(size ? size : 1);
+  size = fread(buffer, 1, size, file);
+
+  uint64_t start = n1_gettimestamp_microseconds();
+  struct n1_CSV_Parser* buffer_parser = n1_create_csv_parser_from_buffer(buffer, size);
+  n1_csv_parse_threaded_avx256(buffer_parser, ',', '"', '\n');
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  PRINT_LOG_PARSER(filename, buffer_parser, "avx256 threaded buffer", (end - start));
+
+  start = n1_gettimestamp_microseconds();
+  struct n1_CSV_Parser* fd_parser = n1_create_csv_parser_from_fd(fileno(file));
+  n1_csv_parse_threaded_avx256(fd_parser, ',', '"', '\n');
+  end = n1_gettimestamp_microseconds();
+  
+  PRINT_LOG_PARSER(filename, fd_parser, "avx256 threaded fd", (end - start));
+  
+  const int8_t ok = compare_parsers(parser, buffer_parser) && compare_parsers(parser, fd_parser);
+  if(!ok){
+    printf("memory source test FAILED\n");
+  }
+  
+  fclose(file);
+  n1_destroy_csv_parser(fd_parser);
+  n1_destroy_csv_parser(buffer_parser);
+  n1_destroy_csv_parser(parser);
+  free(buffer);
+  return ok;
+}
+
+//Parses the file into columns, checks it against the row layout and times scanning every column.
+int8_t test_columns(const char* filename){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  if(!parser->file_size){
+    n1_destroy_csv_parser(parser);
+    return 1;
+  }
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  uint64_t start = n1_gettimestamp_microseconds();
+  struct n1_CSV_Parser* column_parser = n1_create_csv_parser_mapped(filename);
+  n1_csv_set_cell_layout(column_parser, N1_CSV_CELL_LAYOUT_COLUMNS);
+  n1_csv_parse_threaded_avx256(column_parser, ',', '"', '\n');
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  PRINT_LOG_PARSER(filename, column_parser, "avx256 threaded columns", (end - start));
+
+  int8_t ok = compare_parsers(parser, column_parser);
+
+  //total length of every column, once through the column arrays and once cell by cell
+  uint64_t time[2];
+  uint64_t length[2] = {0, 0};
+  
+  start = n1_gettimestamp_microseconds();
+  for(uint32_t x = 0; ok && x < column_parser->column_count; x++){
+    const uint32_t* starts = n1_csv_get_column(column_parser, x);
+    const uint32_t* next   = n1_csv_get_column(column_parser, x + 1);
+    
+    for(uint32_t i = 0; i < column_parser->row_count; i++){
+      length[0] += next[i] - starts[i] - 1;
+    }
+  }
+  time[0] = n1_gettimestamp_microseconds() - start;
+  
+  start = n1_gettimestamp_microseconds();
+  for(uint32_t x = 0; ok && x < parser->column_count; x++){
+    for(uint32_t i = 0; i < parser->row_count; i++){
+      length[1] += n1_csv_get_cell_transient(parser, x, i).length;
+    }
+  }
+  time[1] = n1_gettimestamp_microseconds() - start;
+  
+  printf("column scan took %f ms, cell by cell %f ms\n", time[0] / 1000.0, time[1] / 1000.0);
+  
+  ok = ok && length[0] == length[1];
+  if(!ok){
+    printf("column test FAILED\n");
+  }
+  
+  n1_destroy_csv_parser(column_parser);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Parses every other column, and the first and last column by name, and checks them against a full parse.
+int8_t test_projection(const char* filename){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  if(!parser->file_size){
+    n1_destroy_csv_parser(parser);
+    return 1;
+  }
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  const uint32_t column_count = parser->column_count;
+  uint32_t*      columns      = (uint32_t*)malloc(column_count * sizeof(uint32_t));
+  uint32_t       selected     = 0;
+  for(uint32_t x = 0; x < column_count; x += 2){
+    columns[selected++] = x;
+  }
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  struct n1_CSV_Parser* index_parser = n1_create_csv_parser_mapped(filename);
+  n1_csv_select_columns(index_parser, columns, selected);
+  n1_csv_parse_threaded_avx256(index_parser, ',', '"', '\n');
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  PRINT_LOG_PARSER(filename, index_parser, "avx256 threaded every other column", (end - start));
+
+  //header cells as names, without quotes
+  char names[2][256];
+  const char* name_list[2] = {names[0], names[1]};
+  for(int i = 0; i < 2; i++){
+    n1_CSV_String s = n1_csv_get_cell_transient(parser, i ? column_count - 1 : 0, 0);
+    if(s.length && s.data[0] == '"'){
+      s.data++;
+      s.length = s.length >= 2 ? s.length - 2 : 0;
+    }
+    snprintf(names[i], sizeof(names[i]), "%.*s", (int)s.length, s.data);
+  }
+  
+  struct n1_CSV_Parser* name_parser = n1_create_csv_parser(filename);
+  n1_csv_select_columns_by_name(name_parser, name_list, 2);
+  n1_csv_parse_threaded_avx256(name_parser, ',', '"', '\n');
+  
+  int8_t ok = index_parser->row_count == parser->row_count && index_parser->column_count == selected;
+  
+  for(uint32_t i = 0; ok && i < parser->row_count; i++){
+    for(uint32_t x = 0; ok && x < selected; x++){
+      n1_CSV_String s0 = n1_csv_get_cell_transient(parser, columns[x], i);
+      n1_CSV_String s1 = n1_csv_get_cell_transient(index_parser, x, i);
+      ok = s0.length == s1.length && !memcmp(s0.data, s1.data, s0.length);
+    }
+    
+    //other columns can share the name of the first or last one
+    n1_CSV_String s0 = n1_csv_get_cell_transient(parser, column_count - 1, i);
+    n1_CSV_String s1 = n1_csv_get_cell_transient(name_parser, name_parser->column_count - 1, i);
+    ok = ok && s1.data && s0.length == s1.length && !memcmp(s0.data, s1.data, s0.length);
+  }
+
+  if(!ok){
+    printf("projection test FAILED\n");
+  }
+
+  free(columns);
+  n1_destroy_csv_parser(name_parser);
+  n1_destroy_csv_parser(index_parser);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Checks the cells of quoted.csv, then repeats its quoted cells in a larger file and checks every tokenizer
+//against a slow parse, with a pool so quoted cells straddle section boundaries.
+int8_t test_quoted(const char* filename, const char* sections_filename){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+  n1_csv_parse_slow(parser, ',', '"', '\n');
+
+  const char* expected[][3] = {
+    {"id", "name", "comment"},
+    {"1", "\"Smith, John\"", "\"said \"\"hi\"\"\nand left\""},
+    {"2", "\"\"\"quoted\"\"\"", "plain"},
+    {"3", "\"\"", "\"\"\"\""}
+  };
+  
+  int8_t ok = parser->row_count == 4 && parser->column_count == 3;
+  for(uint32_t y = 0; ok && y < 4; y++){
+    for(uint32_t x = 0; ok && x < 3; x++){
+      n1_CSV_String cell = n1_csv_get_cell_transient(parser, x, y);
+      ok = cell.length == strlen(expected[y][x]) && !memcmp(cell.data, expected[y][x], cell.length);
+    }
+  }
+  n1_destroy_csv_parser(parser);
+
+  FILE* file = fopen(sections_filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  //quoted cells longer than a morsel cross several boundaries
+  char long_cell[6000];
+  for(uint32_t i = 0; i < sizeof(long_cell) - 1; i++){
+    long_cell[i] = i % 61 == 0 ? '\n' : i % 23 == 0 ? ',' : 'a' + i % 26;
+  }
+  long_cell[sizeof(long_cell) - 1] = 0;
+
+  const uint32_t row_count = 20000;
+  fprintf(file, "id,name,comment\n");
+  for(uint32_t i = 0; i < row_count; i++){
+    switch(i % 5){
+    case 0: fprintf(file, "%u,\"Smith, John %u\",\"said \"\"hi\"\"\nand left\"\n", i, i); break;
+    case 1: fprintf(file, "%u,\"\"\"quoted\"\"\",plain\n", i); break;
+    case 2: fprintf(file, "%u,\"\",\"\"\"\"\n", i); break;
+    case 3: fprintf(file, "%u,\"%s\",\"\"\"\n\"\"\"\n", i, i % 50 == 3 ? long_cell : ",\n"); break;
+    case 4: fprintf(file, "%u,plain %u,\"\"\"\"\"\"\"\"\n", i, i); break;
+    }
+  }
+  fclose(file);
+
+  void (*parsefuncs[])(struct n1_CSV_Parser* parser, char delim, char quote, char newline) = {
+    n1_csv_parse_threaded_slow,
+    n1_csv_parse_threaded_sse2,
+    n1_csv_parse_threaded_avx256,
+    n1_csv_parse_threaded_avx512
+  };
+  const uint32_t parse_count = n1_csv_get_cpu_features() & N1_CSV_CPU_FEATURE_AVX512BW ? 4 : 3;
+
+  n1_CSV_ThreadPool* pool = n1_create_csv_thread_pool(4);
+  
+  struct n1_CSV_Parser* reference = n1_create_csv_parser_mapped(sections_filename);
+  n1_csv_parse_slow(reference, ',', '"', '\n');
+  ok = ok && reference->row_count == row_count + 1 && reference->cell_count == (uint64_t)(row_count + 1) * 3;
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  for(uint32_t f = 0; ok && f < parse_count * 2; f++){
+    parser = f & 1 ? n1_create_csv_parser_mapped(sections_filename) : n1_create_csv_parser(sections_filename);
+    n1_csv_set_thread_pool(parser, pool);
+    parsefuncs[f / 2](parser, ',', '"', '\n');
+    
+    ok = compare_parsers(reference, parser);
+    n1_destroy_csv_parser(parser);
+  }
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  n1_destroy_csv_parser(reference);
+  n1_destroy_csv_thread_pool(pool);
+  
+  printf("quoted test %s, %u parses took %f ms\n", ok ? "passed" : "FAILED", parse_count * 2, (end - start) / 1000.0);
+  return ok;
+}
+
+//Appends rows in pieces that cut through cells and quotes, and checks every refresh against a full parse.
+int8_t test_refresh(const char* filename, struct n1_CSV_Parser* (*createfunc)(const char* filename), N1_CSV_CELL_LAYOUT layout, const char* info){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+  fprintf(file, "id,name,text\n");
+  fflush(file);
+
+  struct n1_CSV_Parser* parser = createfunc(filename);
+  n1_csv_set_cell_layout(parser, layout);
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  char     rows[1 << 16];
+  uint32_t rows_length = 0;
+  for(uint32_t i = 0; rows_length + 128 < sizeof(rows); i++){
+    rows_length += snprintf(rows + rows_length, sizeof(rows) - rows_length, "%u,name %u,\"text, \"\"%u\"\"\nmore\"\n", i, i, i);
+  }
+  
+  int8_t   ok      = N1_CSV_TRUE;
+  uint64_t time    = 0;
+  uint32_t written = 0;
+  
+  for(uint32_t piece = 7; written < rows_length && ok; piece = piece * 3 % 1021 + 1){
+    if(written + piece > rows_length){
+      piece = rows_length - written;
+    }
+    fwrite(rows + written, 1, piece, file);
+    fflush(file);
+    written += piece;
+    
+    uint64_t start = n1_gettimestamp_microseconds();
+    n1_csv_refresh(parser, ',', '"', '\n');
+    time += n1_gettimestamp_microseconds() - start;
+    
+    struct n1_CSV_Parser* full_parser = createfunc(filename);
+    n1_csv_parse_threaded_avx256(full_parser, ',', '"', '\n');
+    ok = compare_parsers(parser, full_parser);
+    n1_destroy_csv_parser(full_parser);
+  }
+
+  printf("refresh test (%s) %s, %u rows, %f ms refreshing\n", info, ok ? "passed" : "FAILED", parser->row_count, time / 1000.0);
+  
+  fclose(file);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Writes a file larger than 4 GiB and checks that cells past the 4 GiB mark are read back correctly.
+//Only run with --large-file.
+int8_t test_large_file(const char* filename){
+  
+  const uint64_t min_size = (1ull << 32) + (1ull << 26);
+  const char*    padding  = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz";
+
+  char     row[256];
+  uint32_t row_length = (uint32_t)snprintf(row, sizeof(row), "%010u,%s,\"quoted, %010u\"\n", 0, padding, 0);
+  uint32_t row_count  = (uint32_t)((min_size + row_length - 1) / row_length);
+  
+  FILE* file = fopen(filename, "rb");
+  if(file){
+    fclose(file);
+  }else{
+    file = fopen(filename, "wb");
+    if(!file){
+      return 0;
+    }
+
+    const uint32_t rows_per_write = (1 << 20) / row_length;
+    char*          buffer         = (char*)malloc(rows_per_write * row_length + 1);
+    
+    for(uint32_t i = 0; i < row_count; i += rows_per_write){
+      char* at = buffer;
+      for(uint32_t x = i; x < i + rows_per_write && x < row_count; x++){
+        at += snprintf(at, row_length + 1, "%010u,%s,\"quoted, %010u\"\n", x, padding, x);
+      }
+      fwrite(buffer, 1, at - buffer, file);
+    }
+    
+    free(buffer);
+    fclose(file);
+  }
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  PRINT_LOG_PARSER(filename, parser, "avx256 threaded mapped", (end - start));
+  
+  int8_t ok = parser->row_count == row_count && parser->column_count == 3;
+  
+  const uint32_t rows_to_check[] = {0, 1, row_count / 2, row_count - 2, row_count - 1};
+  for(size_t i = 0; ok && i < sizeof(rows_to_check) / sizeof(*rows_to_check); i++){
+    char expected[64];
+    
+    int length = snprintf(expected, sizeof(expected), "%010u", rows_to_check[i]);
+    n1_CSV_String s = n1_csv_get_cell_transient(parser, 0, rows_to_check[i]);
+    ok = s.data && s.length == (uint32_t)length && !memcmp(s.data, expected, length);
+
+    length = snprintf(expected, sizeof(expected), "\"quoted, %010u\"", rows_to_check[i]);
+    s = n1_csv_get_cell_transient(parser, 2, rows_to_check[i]);
+    ok = ok && s.data && s.length == (uint32_t)length && !memcmp(s.data, expected, length);
+  }
+  
+  printf("large file test %s\n", ok ? "passed" : "FAILED");
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Writes typed columns with some invalid cells, converts them back and compares against strtoll and strtod.
+int8_t test_convert(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+  
+  const uint32_t row_count = 100000;
+  fprintf(file, "int,double,bool,timestamp\r\n");
+  for(uint32_t i = 0; i < row_count; i++){
+    if(i % 101 == 0){
+      fprintf(file, ",x,maybe,2020-13-01\r\n");
+    }else{
+      fprintf(file, "%lld,\"%.*f\",%s,2020-01-%02uT%02u:%02u:%02u\r\n",
+              (long long)i * 1000003 - 50000000, i % 9, i * 0.37 - 1000.0, i & 1 ? "true" : "F", 1 + i % 28, i % 24, i % 60, i % 59);
+    }
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+  int64_t*  ints       = (int64_t*)malloc(row_count * sizeof(int64_t));
+  double*   doubles    = (double*)malloc(row_count * sizeof(double));
+  uint8_t*  bools      = (uint8_t*)malloc(row_count);
+  int64_t*  timestamps = (int64_t*)malloc(row_count * sizeof(int64_t));
+  uint64_t* nulls      = (uint64_t*)malloc((row_count + 63) / 64 * sizeof(uint64_t));
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  uint64_t converted = n1_csv_convert_column(parser, 0, 1, row_count, '"', N1_CSV_TYPE_INT64, ints, nulls);
+  converted += n1_csv_convert_column(parser, 1, 1, row_count, '"', N1_CSV_TYPE_DOUBLE, doubles, nulls);
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  converted += n1_csv_convert_column(parser, 2, 1, row_count, '"', N1_CSV_TYPE_BOOL, bools, nulls);
+  converted += n1_csv_convert_column(parser, 3, 1, row_count, '"', N1_CSV_TYPE_TIMESTAMP, timestamps, nulls);
+  
+  int8_t ok = converted == 4 * (uint64_t)(row_count - (row_count + 100) / 101);
+  
+  for(uint32_t i = 0; ok && i < row_count; i++){
+    n1_CSV_String s0 = n1_csv_get_cell_transient(parser, 0, i + 1);
+    n1_CSV_String s1 = n1_csv_get_cell_transient(parser, 1, i + 1);
+    
+    char buffer[64];
+    memcpy(buffer, s0.data, s0.length);
+    buffer[s0.length] = 0;
+    ok = i % 101 == 0 ? ((nulls[i / 64] >> (i % 64)) & 1) && !ints[i] : ints[i] == strtoll(buffer, NULL, 10);
+    
+    if(i % 101){
+      memcpy(buffer, s1.data + 1, s1.length - 2);
+      buffer[s1.length - 2] = 0;
+      ok = ok && doubles[i] == strtod(buffer, NULL) && bools[i] == (i & 1) && !((nulls[i / 64] >> (i % 64)) & 1);
+    }
+  }
+  ok = ok && timestamps[1] == (1577836800ll + 86400 + 3600 + 60 + 1) * 1000000;
+
+  //days past the end of the month are invalid, february has 29 in leap years
+  const char* dates[] = {"2021-02-28", "2021-02-29", "2021-02-30", "2021-04-31", "2020-02-29", "1900-02-29", "2000-02-29", "2021-12-31"};
+  const int8_t valid[] = {1, 0, 0, 0, 1, 0, 1, 1};
+  for(uint32_t i = 0; i < sizeof(dates) / sizeof(*dates); i++){
+    int64_t timestamp;
+    ok = ok && n1_csv_convert_timestamp(dates[i], 10, &timestamp) == valid[i];
+  }
+  
+  printf("convert test %s, int64 and double columns took %f ms\n", ok ? "passed" : "FAILED", (end - start) / 1000.0);
+
+  free(ints);
+  free(doubles);
+  free(bools);
+  free(timestamps);
+  free(nulls);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Infers the schema of schema.csv, which has a column of each type and an int64 column of only 0 and 1,
+//and converts it with the schema.
+int8_t test_schema(const char* filename){
+
+  struct n1_CSV_Parser* parser = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+  
+  uint64_t start = n1_gettimestamp_microseconds();
+  n1_CSV_Schema* schema = n1_csv_infer_schema(parser, 1, 1000, '"');
+  uint64_t end = n1_gettimestamp_microseconds();
+  
+  const uint32_t    row_count  = 5;
+  const N1_CSV_TYPE expected[] = {N1_CSV_TYPE_INT64, N1_CSV_TYPE_DOUBLE, N1_CSV_TYPE_BOOL, N1_CSV_TYPE_TIMESTAMP, N1_CSV_TYPE_STRING, N1_CSV_TYPE_STRING, N1_CSV_TYPE_INT64};
+  
+  int8_t ok = schema->column_count == 7 && schema->sampled_rows == row_count;
+  for(uint32_t x = 0; ok && x < schema->column_count; x++){
+    ok = schema->columns[x].type == expected[x] && schema->columns[x].nullable == (x == 1 || x == 5);
+  }
+  //name, ""333"" without the quotes around it
+  ok = ok && schema->columns[4].max_width == 13 && schema->columns[5].max_width == 0;
+
+  //one allocation per column, sized from the schema
+  void*     values[7];
+  uint64_t* nulls[7];
+  for(uint32_t x = 0; x < 7; x++){
+    values[x] = malloc((size_t)n1_csv_get_type_size(schema->columns[x].type) * row_count + 1);
+    nulls[x]  = (uint64_t*)malloc(sizeof(uint64_t));
+  }
+  
+  //prices of rows 2 and 5 are empty
+  uint64_t converted = ok ? n1_csv_convert_columns(parser, schema, 1, row_count, values, nulls) : 0;
+  ok = ok && converted == 5 * row_count - 2;
+  ok = ok && ((int64_t*)values[0])[4] == 5 && ((double*)values[1])[0] == 1.01 && ((double*)values[1])[3] == -450.0 && nulls[1][0] == 0x12;
+  ok = ok && ((uint8_t*)values[2])[0] == 1 && ((uint8_t*)values[2])[1] == 0 && ((int64_t*)values[6])[2] == 1;
+  ok = ok && ((int64_t*)values[3])[3] == 1582934400ll * 1000000 && ((int64_t*)values[3])[4] == (1640995199ll * 1000000 + 500000);
+  
+  printf("schema test %s, inferring took %f ms\n", ok ? "passed" : "FAILED", (end - start) / 1000.0);
+
+  for(uint32_t x = 0; x < 7; x++){
+    free(values[x]);
+    free(nulls[x]);
+  }
+  n1_destroy_csv_schema(schema);
+  n1_destroy_csv_parser(parser);
+  return ok;
+}
+
+//Filters filters.csv with each filter kind and checks the ids of the rows that are kept.
+int8_t test_filters(const char* filename){
+
+  struct n1_CSV_Parser* (*createfuncs[])(const char* filename) = {n1_create_csv_parser, n1_create_csv_parser_mapped};
+  int8_t ok = 1;
+  
+  for(uint32_t f = 0; f < 2; f++){
+    //paris and porto rows with a number from 100 to 199.9 as price
+    struct n1_CSV_Parser* parser = createfuncs[f](filename);
+    n1_csv_add_filter_prefix(parser, 1, "p");
+    n1_csv_add_filter_range(parser, 2, 100.0, 199.9);
+    n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+
+    const char ids[] = {'1', '2', '5'};
+    ok = ok && parser->row_count == 3 && parser->column_count == 4;
+    for(uint32_t y = 0; ok && y < parser->row_count; y++){
+      n1_CSV_String id = n1_csv_get_cell_transient(parser, 0, y);
+      ok = id.length == 1 && id.data[0] == ids[y];
+    }
+    //the file isn't kept in memory for the filters, paged parsers still read cells page by page
+    ok = ok && !parser->filter_data && (f == 1 || !parser->file_data);
+    n1_destroy_csv_parser(parser);
+
+    //the note of row 9 spans two lines
+    const char* values[] = {"oslo", "lima", "1"};
+    parser = createfuncs[f](filename);
+    n1_csv_select_columns(parser, (const uint32_t[]){3}, 1);
+    n1_csv_add_filter_in(parser, 1, values, 3);
+    n1_csv_add_filter_equal(parser, 0, "9");
+    n1_csv_parse_threaded_sse2(parser, ',', '"', '\n');
+    
+    n1_CSV_String note = n1_csv_get_cell_transient(parser, 0, 0);
+    ok = ok && parser->row_count == 1 && parser->column_count == 1 && note.length == 15 && !memcmp(note.data, "\"multi\nline, 9\"", 15);
+    n1_destroy_csv_parser(parser);
+
+    //values are unescaped, doubled quotes in the cell are read as one
+    parser = createfuncs[f](filename);
+    n1_csv_add_filter_equal(parser, 1, "po\"rto");
+    n1_csv_add_filter_prefix(parser, 1, "po\"r");
+    n1_csv_add_filter_range(parser, 0, 6, 6);
+    n1_csv_parse_slow(parser, ',', '"', '\n');
+
+    n1_CSV_String id = n1_csv_get_cell_transient(parser, 0, 0);
+    ok = ok && parser->row_count == 1 && id.length == 1 && id.data[0] == '6';
+    n1_destroy_csv_parser(parser);
+  }
+
+  printf("filter test %s\n", ok ? "passed" : "FAILED");
+  return ok;
+}
+
+//Parses a file once through the index and reopens it from the index, with both cell layouts.
+int8_t test_index(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  const uint32_t row_count = 100000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,\"b, %u\",c%u\n", i, i * 3, i % 17);
+  }
+  fclose(file);
+
+  int8_t   ok        = 1;
+  uint64_t load_time = 0;
+  
+  for(uint32_t layout = 0; layout < 2; layout++){
+    struct n1_CSV_Parser* parsed = n1_create_csv_parser(filename);
+    n1_csv_set_cell_layout(parsed, (N1_CSV_CELL_LAYOUT)layout);
+    n1_csv_parse_threaded_avx256(parsed, ',', '"', '\n');
+    ok = ok && n1_csv_save_index(parsed, NULL, ',', '"', '\n');
+    
+    struct n1_CSV_Parser* loaded = n1_create_csv_parser(filename);
+    n1_csv_set_cell_layout(loaded, (N1_CSV_CELL_LAYOUT)layout);
+
+    uint64_t start = n1_gettimestamp_microseconds();
+    ok = ok && n1_csv_load_index(loaded, NULL, ',', '"', '\n');
+    load_time += n1_gettimestamp_microseconds() - start;
+
+    //an index saved with other settings isn't used
+    struct n1_CSV_Parser* other = n1_create_csv_parser(filename);
+    n1_csv_set_cell_layout(other, (N1_CSV_CELL_LAYOUT)layout);
+    ok = ok && !n1_csv_load_index(other, NULL, ';', '"', '\n');
+    
+    ok = ok && loaded->row_count == row_count && loaded->column_count == 3 && loaded->cell_count == parsed->cell_count;
+    for(uint32_t y = 0; ok && y < row_count; y += 97){
+      for(uint32_t x = 0; ok && x < 3; x++){
+        n1_CSV_String a = n1_csv_get_cell_transient(parsed, x, y);
+        n1_CSV_String b = n1_csv_get_cell_transient(loaded, x, y);
+        char buffer[64];
+        memcpy(buffer, a.data, a.length);
+        ok = a.length == b.length && !memcmp(buffer, b.data, b.length);
+      }
+    }
+    
+    n1_destroy_csv_parser(other);
+    n1_destroy_csv_parser(loaded);
+    n1_destroy_csv_parser(parsed);
+  }
+
+  //the first cached parse writes the index and the second one loads it
+  const char* index_filename = "test_data/index_cached.n1idx";
+  remove(index_filename);
+
+  struct n1_CSV_Parser* first = n1_create_csv_parser(filename);
+  n1_csv_parse_cached(first, index_filename, ',', '"', '\n');
+  ok = ok && !first->index_data && first->row_count == row_count;
+
+  struct n1_CSV_Parser* second = n1_create_csv_parser(filename);
+  n1_csv_parse_cached(second, index_filename, ',', '"', '\n');
+  ok = ok && second->index_data && second->row_count == row_count && second->cell_count == first->cell_count;
+  for(uint32_t y = 0; ok && y < row_count; y += 101){
+    n1_CSV_String a = n1_csv_get_cell_transient(first, 1, y);
+    n1_CSV_String b = n1_csv_get_cell_transient(second, 1, y);
+    ok = a.length == b.length && !memcmp(a.data, b.data, a.length);
+  }
+  n1_destroy_csv_parser(second);
+  n1_destroy_csv_parser(first);
+
+  //a changed file is parsed again instead of being loaded from the stale index
+  file = fopen(filename, "ab");
+  if(!file){
+    return 0;
+  }
+  fprintf(file, "%u,\"b, %u\",c%u\n", row_count, row_count * 3, row_count % 17);
+  fclose(file);
+
+  struct n1_CSV_Parser* changed = n1_create_csv_parser(filename);
+  n1_csv_parse_cached(changed, index_filename, ',', '"', '\n');
+  ok = ok && !changed->index_data && changed->row_count == row_count + 1;
+  n1_CSV_String last = n1_csv_get_cell_transient(changed, 0, row_count);
+  ok = ok && last.length == 6 && !memcmp(last.data, "100000", 6);
+  n1_destroy_csv_parser(changed);
+  
+  printf("index test %s, loading took %f ms\n", ok ? "passed" : "FAILED", load_time / 2000.0);
+  return ok;
+}
+
+//Reads rows of a sparse parse in a scattered order and compares them with a parse that stores every cell.
+int8_t test_sparse(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  const uint32_t row_count = 100000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,\"multi\nline %u\",%s\r\n", i, i * 7, i % 3 ? "x" : "");
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* dense = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(dense, ',', '"', '\n');
+
+  struct n1_CSV_Parser* (*createfuncs[])(const char* filename) = {n1_create_csv_parser, n1_create_csv_parser_mapped};
+  const uint32_t intervals[] = {1, 16};
+  int8_t   ok          = 1;
+  uint64_t access_time = 0;
+  
+  for(uint32_t f = 0; f < 2; f++){
+    for(uint32_t k = 0; k < 2; k++){
+      struct n1_CSV_Parser* sparse = createfuncs[f](filename);
+      n1_csv_set_cell_layout(sparse, N1_CSV_CELL_LAYOUT_SPARSE);
+      n1_csv_set_row_sampling(sparse, intervals[k]);
+      n1_csv_parse_threaded_avx256(sparse, ',', '"', '\n');
+
+      ok = ok && !sparse->cell_data && sparse->row_count == dense->row_count && sparse->cell_count == dense->cell_count && sparse->column_count == 3;
+      
+      uint64_t start = n1_gettimestamp_microseconds();
+      for(uint32_t i = 0; ok && i < 10000; i++){
+        uint32_t y = (uint32_t)(i * 7919ull % row_count);
+        for(uint32_t x = 0; ok && x < 3; x++){
+          n1_CSV_String a = n1_csv_get_cell_transient(dense, x, y);
+          n1_CSV_String b = n1_csv_get_cell_transient(sparse, x, y);
+          ok = a.length == b.length && !memcmp(a.data, b.data, a.length);
+        }
+      }
+      access_time += n1_gettimestamp_microseconds() - start;
+      
+      n1_destroy_csv_parser(sparse);
+    }
+  }
+  n1_destroy_csv_parser(dense);
+  
+  printf("sparse test %s, reading a row took %f us on average\n", ok ? "passed" : "FAILED", access_time / 40000.0);
+  return ok;
+}
+
+int8_t test_page_cache(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  static char text[6000];
+  memset(text, 'a', sizeof(text));
+  
+  //some cells are longer than a cache block
+  const uint32_t row_count = 50000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,%.*s,\"quoted %u\"\n", i, i % 97 ? (int)(i % 40) : (int)sizeof(text), text, i * 3);
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* mapped = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(mapped, ',', '"', '\n');
+
+  const size_t cache_sizes[] = {64 << 10, N1_CSV_PAGE_CACHE_SIZE, 0};
+  int8_t ok = 1;
+  
+  for(uint32_t c = 0; c < 3; c++){
+    struct n1_CSV_Parser* paged = n1_create_csv_parser(filename);
+    n1_csv_set_page_cache(paged, cache_sizes[c], N1_CSV_PAGE_READ_AHEAD);
+    n1_csv_parse_threaded_avx256(paged, ',', '"', '\n');
+
+    ok = ok && paged->row_count == mapped->row_count && paged->column_count == 3;
+    
+    //row major, column major and scattered
+    for(uint32_t order = 0; ok && order < 3; order++){
+      for(uint32_t i = 0; ok && i < row_count * 3; i++){
+        uint32_t x = order == 1 ? i / row_count : i % 3;
+        uint32_t y = order == 0 ? i / 3 : order == 1 ? i % row_count : (uint32_t)(i * 7919ull % row_count);
+        
+        n1_CSV_String a = n1_csv_get_cell_transient(mapped, x, y);
+        n1_CSV_String b = n1_csv_get_cell_transient(paged, x, y);
+        ok = a.length == b.length && !memcmp(a.data, b.data, a.length);
+      }
+    }
+    
+    uint64_t hits, misses;
+    n1_csv_get_page_cache_stats(paged, &hits, &misses);
+    printf("page cache of %zu KB: %llu hits, %llu misses\n", cache_sizes[c] >> 10, (unsigned long long)hits, (unsigned long long)misses);
+    
+    n1_destroy_csv_parser(paged);
+  }
+  n1_destroy_csv_parser(mapped);
+  
+  printf("page cache test %s\n", ok ? "passed" : "FAILED");
+  return ok;
+}
+
+int8_t test_batch(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  const uint32_t row_count = 100000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,name %u,\"quoted, %u\",%f\n", i, i * 13, i % 7, i * 0.25);
+  }
+  fclose(file);
+
+  const uint32_t ref_count = 100000;
+  n1_CSV_CellRef* refs  = (n1_CSV_CellRef*)malloc(ref_count * sizeof(n1_CSV_CellRef));
+  n1_CSV_String*  cells = (n1_CSV_String*)malloc(ref_count * sizeof(n1_CSV_String));
+  
+  //scattered, some out of range
+  for(uint32_t i = 0; i < ref_count; i++){
+    refs[i].row    = (uint32_t)(i * 7919ull % (row_count + 10));
+    refs[i].column = i % 5;
+  }
+
+  struct n1_CSV_Parser* mapped = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(mapped, ',', '"', '\n');
+
+  //buffer parsers have no file to read cells from
+  file = fopen(filename, "rb");
+  char*  buffer = (char*)malloc(mapped->file_size);
+  size_t size   = fread(buffer, 1, mapped->file_size, file);
+  fclose(file);
+  
+  //paged, mapped and buffer parsers, then paged and buffer parsers with a sparse layout
+  const int8_t sources[] = {0, 1, 2, 0, 2};
+  int8_t       ok        = 1;
+  uint64_t     times[2];
+  
+  for(uint32_t f = 0; f < 5; f++){
+    struct n1_CSV_Parser* parser = sources[f] == 2 ? n1_create_csv_parser_from_buffer(buffer, size) :
+                                   sources[f] == 1 ? n1_create_csv_parser_mapped(filename) : n1_create_csv_parser(filename);
+    if(f >= 3){
+      n1_csv_set_cell_layout(parser, N1_CSV_CELL_LAYOUT_SPARSE);
+      n1_csv_set_row_sampling(parser, 16);
+    }
+    n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+    
+    uint64_t start = n1_gettimestamp_microseconds();
+    uint64_t found = n1_csv_get_cells(parser, refs, ref_count, cells);
+    if(f < 2){
+      times[f] = n1_gettimestamp_microseconds() - start;
+    }
+
+    //cells stay valid while others are read
+    for(uint32_t i = 0; i < 1000; i++){
+      n1_csv_get_cell_transient(parser, i % 4, i * 31);
+    }
+    
+    uint64_t expected = 0;
+    for(uint32_t i = 0; ok && i < ref_count; i++){
+      n1_CSV_String a = n1_csv_get_cell_transient(mapped, refs[i].column, refs[i].row);
+      ok        = a.length == cells[i].length && (a.data != NULL) == (cells[i].data != NULL) && (!a.data || !memcmp(a.data, cells[i].data, a.length));
+      expected += a.data != NULL;
+    }
+    ok = ok && found == expected;
+
+    n1_CSV_String row_cells[4 * 3];
+    n1_csv_get_rows(parser, row_count - 2, 3, row_cells);
+    for(uint32_t i = 0; ok && i < 4 * 3; i++){
+      n1_CSV_String a = n1_csv_get_cell_transient(mapped, i % 4, row_count - 2 + i / 4);
+      ok = a.length == row_cells[i].length && (a.data != NULL) == (row_cells[i].data != NULL) && (!a.data || !memcmp(a.data, row_cells[i].data, a.length));
+    }
+    
+    n1_destroy_csv_parser(parser);
+  }
+  n1_destroy_csv_parser(mapped);
+  free(buffer);
+  free(refs);
+  free(cells);
+  
+  printf("batch test %s, %u cells took %f ms paged and %f ms mapped\n", ok ? "passed" : "FAILED", ref_count, times[0] / 1000.0, times[1] / 1000.0);
+  return ok;
+}
+
+int8_t test_io(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  const uint32_t row_count = 400000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,\"name\n%u\",%f\n", i, i * 3, i * 0.5);
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* mapped = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(mapped, ',', '"', '\n');
+
+  const N1_CSV_IO io[]     = {N1_CSV_IO_PREAD, N1_CSV_IO_URING, N1_CSV_IO_URING};
+  const int8_t    direct[] = {0, 0, 1};
+  const char*     names[]  = {"pread", "io_uring", "io_uring O_DIRECT"};
+  int8_t          ok       = 1;
+  
+  for(uint32_t i = 0; i < 3; i++){
+    struct n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+    n1_csv_set_io(parser, io[i], N1_CSV_READ_QUEUE_DEPTH, direct[i]);
+
+    //direct reads stay off where O_DIRECT isn't known
+#if defined(O_DIRECT)
+    ok = ok && parser->io_direct == direct[i];
+#else
+    ok = ok && !parser->io_direct;
+#endif
+
+    uint64_t start = n1_gettimestamp_microseconds();
+    n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+    uint64_t time = n1_gettimestamp_microseconds() - start;
+    
+    ok = ok && compare_parsers(parser, mapped);
+    printf("%s took %f ms\n", names[i], time / 1000.0);
+    
+    n1_destroy_csv_parser(parser);
+  }
+  n1_destroy_csv_parser(mapped);
+  
+  printf("io test %s\n", ok ? "passed" : "FAILED");
+  return ok;
+}
+
+int8_t test_read_block_size(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  const uint32_t row_count = 300000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,\"block\n%u\",%f\n", i, i * 7, i * 0.25);
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* mapped = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(mapped, ',', '"', '\n');
+
+  //Odd sizes get rounded up to a page, blocks larger than a section get clipped to it.
+  const size_t sizes[] = {1, 4096, 12345, N1_CSV_READ_BLOCK_SIZE, 1 << 20, 4 << 20};
+  int8_t       ok      = 1;
+
+  printf("Block size | pread slow (ms) | io_uring threaded (ms)\n---|---|---\n");
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++){
+    double times[2];
+    for(uint32_t j = 0; j < 2; j++){
+      struct n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+      n1_csv_set_io(parser, j ? N1_CSV_IO_URING : N1_CSV_IO_PREAD, N1_CSV_READ_QUEUE_DEPTH, 0);
+      n1_csv_set_read_block_size(parser, sizes[i]);
+
+      uint64_t start = n1_gettimestamp_microseconds();
+      if(j){
+        n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+      }else{
+        n1_csv_parse_slow(parser, ',', '"', '\n');
+      }
+      times[j] = (n1_gettimestamp_microseconds() - start) / 1000.0;
+
+      ok = ok && compare_parsers(parser, mapped);
+      n1_destroy_csv_parser(parser);
+    }
+    printf("%zu | %f | %f\n", sizes[i], times[0], times[1]);
+  }
+  n1_destroy_csv_parser(mapped);
+
+  printf("read block size test %s\n", ok ? "passed" : "FAILED");
+  return ok;
+}
+
+int8_t test_arena(const char* filename){
+
+  FILE* file = fopen(filename, "wb");
+  if(!file){
+    return 0;
+  }
+
+  //large enough for buffers to be reserved from an estimate
+  const uint32_t row_count = 250000;
+  for(uint32_t i = 0; i < row_count; i++){
+    fprintf(file, "%u,\"arena, %u\",%f,%u\n", i, i * 5, i * 0.75, i % 7);
+  }
+  fclose(file);
+
+  struct n1_CSV_Parser* mapped = n1_create_csv_parser_mapped(filename);
+  n1_csv_parse_threaded_avx256(mapped, ',', '"', '\n');
+
+  n1_CSV_Arena* arena = n1_create_csv_arena();
+  int8_t        ok    = 1;
+  double        times[4];
+
+  //first parse allocates buffers, the next ones take them back from the arena
+  for(uint32_t i = 0; i < 4; i++){
+    struct n1_CSV_Parser* parser = i == 3 ? n1_create_csv_parser(filename) : n1_create_csv_parser_mapped(filename);
+    n1_csv_set_arena(parser, arena);
+    if(i == 2){
+      n1_csv_set_cell_layout(parser, N1_CSV_CELL_LAYOUT_COLUMNS);
+    }
+
+    uint64_t start = n1_gettimestamp_microseconds();
+    if(i == 3){
+      n1_csv_parse_slow(parser, ',', '"', '\n');
+    }else{
+      n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+    }
+    times[i] = (n1_gettimestamp_microseconds() - start) / 1000.0;
+
+    ok = ok && compare_parsers(parser, mapped);
+    n1_destroy_csv_parser(parser);
+  }
+  
+  n1_destroy_csv_arena(arena);
+  n1_destroy_csv_parser(mapped);
+  
+  printf("arena test %s, parses took %f, %f, %f (columns) and %f (slow) ms\n",
+         ok ? "passed" : "FAILED", times[0], times[1], times[2], times[3]);
+  return ok;
+}
+
+//Average time to create, parse and destroy small files, with and without a thread pool.
+void test_latency(){
+
+  const uint32_t sizes[] = {1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20};
+  const int      iter    = 200;
+  
+  n1_CSV_ThreadPool* pool = n1_create_csv_thread_pool(0);
+
+  printf("Size | Without pool (us) | With pool (us)\n---|---|---\n");
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++){
+    char filename[64];
+    snprintf(filename, sizeof(filename), "test_data/latency_%u.csv", sizes[i]);
+
+    FILE* file = fopen(filename, "wb");
+    if(!file){
+      continue;
+    }
+    
+    for(uint32_t size = 0, row = 0; size < sizes[i]; row++){
+      size += fprintf(file, "%u,name %u,\"quoted, %u\",%f\n", row, row, row, row * 0.5);
+    }
+    fclose(file);
+
+    uint64_t time[2];
+    for(int use_pool = 0; use_pool < 2; use_pool++){
+      uint64_t start = n1_gettimestamp_microseconds();
+      
+      for(int x = 0; x < iter; x++){
+        struct n1_CSV_Parser* parser = n1_create_csv_parser(filename);
+        if(use_pool){
+          n1_csv_set_thread_pool(parser, pool);
+        }
+        n1_csv_parse_threaded_avx256(parser, ',', '"', '\n');
+        n1_destroy_csv_parser(parser);
+      }
+      
+      time[use_pool] = n1_gettimestamp_microseconds() - start;
+    }
+    
+    printf("%u KB | %f | %f\n", sizes[i] >> 10, (double)time[0] / iter, (double)time[1] / iter);
+  }
+  
+  n1_destroy_csv_thread_pool(pool);
+}
+
+int main(int argc, char** argv){
   const char* filenames[] = {
 
     "test_data/test.csv",
+    "test_data/quoted.csv",
     
     
     "test_data/denver_crime_data/test_data/offense_codes.csv",        
@@ -90,13 +1163,48 @@ int main(){
 #endif
   };
   
+  //tests that check their results return 0 when they fail
+  int failed = 0;
+  
   PRINT_LOG_TABLE_HEADER();
   for(size_t i = 0; i < sizeof(filenames) / sizeof(*filenames); i++){
-    test_csv(filenames[i], n1_csv_parse_slow, "slow");
-    test_csv(filenames[i], n1_csv_parse_threaded_slow, "slow threaded");
-    test_csv(filenames[i], n1_csv_parse_threaded_sse2, "sse2 threaded");
-    test_csv(filenames[i], n1_csv_parse_threaded_avx256, "avx256 threaded");
+    test_csv(filenames[i], n1_create_csv_parser, n1_csv_parse_slow, "slow");
+    test_csv(filenames[i], n1_create_csv_parser, n1_csv_parse_threaded_slow, "slow threaded");
+    test_csv(filenames[i], n1_create_csv_parser, n1_csv_parse_threaded_sse2, "sse2 threaded");
+    test_csv(filenames[i], n1_create_csv_parser, n1_csv_parse_threaded_avx256, "avx256 threaded");
+    test_csv(filenames[i], n1_create_csv_parser_mapped, n1_csv_parse_threaded_sse2, "sse2 threaded mapped");
+    test_csv(filenames[i], n1_create_csv_parser_mapped, n1_csv_parse_threaded_avx256, "avx256 threaded mapped");
+    test_csv(filenames[i], n1_create_csv_parser, n1_csv_parse_auto, "auto threaded");
+    test_csv(filenames[i], n1_create_csv_parser_mapped, n1_csv_parse_auto, "auto threaded mapped");
+    failed += !test_stream(filenames[i], n1_create_csv_parser, "stream");
+    failed += !test_stream(filenames[i], n1_create_csv_parser_mapped, "stream mapped");
+    failed += !test_memory_sources(filenames[i]);
+    failed += !test_columns(filenames[i]);
+    failed += !test_projection(filenames[i]);
   }
-  printf("done\n");
-  return 0;
+
+  failed += !test_quoted("test_data/quoted.csv", "test_data/quoted_sections.csv");
+  test_latency();
+  failed += !test_convert("test_data/convert.csv");
+  failed += !test_schema("test_data/schema.csv");
+  failed += !test_filters("test_data/filters.csv");
+  failed += !test_index("test_data/index.csv");
+  failed += !test_sparse("test_data/sparse.csv");
+  failed += !test_page_cache("test_data/page_cache.csv");
+  failed += !test_batch("test_data/batch.csv");
+  failed += !test_io("test_data/io.csv");
+  failed += !test_read_block_size("test_data/read_block_size.csv");
+  failed += !test_arena("test_data/arena.csv");
+  failed += !test_refresh("test_data/refresh.csv", n1_create_csv_parser, N1_CSV_CELL_LAYOUT_ROWS, "paged");
+  failed += !test_refresh("test_data/refresh.csv", n1_create_csv_parser_mapped, N1_CSV_CELL_LAYOUT_ROWS, "mapped");
+  failed += !test_refresh("test_data/refresh.csv", n1_create_csv_parser_mapped, N1_CSV_CELL_LAYOUT_COLUMNS, "mapped columns");
+  
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "--large-file")){
+      failed += !test_large_file("test_data/large_file.csv");
+    }
+  }
+  
+  printf("done, %d tests failed\n", failed);
+  return failed ? 1 : 0;
 }